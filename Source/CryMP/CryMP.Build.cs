@@ -9,9 +9,9 @@ public class CryMP : ModuleRules
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
 		PublicDependencyModuleNames.AddRange(new string[]
-			{ "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput" });
+			{ "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput", "NetCore" });
 
-		PrivateDependencyModuleNames.AddRange(new string[] { "AnimGraphRuntime", "ReplicationGraph" });
+		PrivateDependencyModuleNames.AddRange(new string[] { "AnimGraphRuntime", "ReplicationGraph", "SignificanceManager", "Json" });
 
 		PublicIncludePaths.AddRange(new string[]
 			{ "CryMP/Public/Player", "CryMP/Public/Framework", "CryMP/Public/Guns" });
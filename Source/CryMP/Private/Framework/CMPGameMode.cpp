@@ -4,9 +4,59 @@
 #include "Framework/CMPGameMode.h"
 #include "Player/CMPCharacter.h"
 #include "Player/CMPPlayerController.h"
+#include "System/CMPCharacterPoolSubsystem.h"
 
 ACMPGameMode::ACMPGameMode()
 {
 	DefaultPawnClass = ACMPCharacter::StaticClass();
 	PlayerControllerClass = ACMPPlayerController::StaticClass();
 }
+
+APawn* ACMPGameMode::SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform)
+{
+	UClass* PawnClass = GetDefaultPawnClassForController(NewPlayer);
+	if (PawnClass && PawnClass->IsChildOf<ACMPCharacter>())
+	{
+		if (const auto Pool = UCMPCharacterPoolSubsystem::Get(GetWorld()))
+		{
+			if (const auto Character = Pool->AcquireCharacter(PawnClass, SpawnTransform))
+			{
+				Character->SetInstigator(GetInstigator());
+				return Character;
+			}
+		}
+	}
+
+	return Super::SpawnDefaultPawnAtTransform_Implementation(NewPlayer, SpawnTransform);
+}
+
+void ACMPGameMode::RespawnPlayer(AController* Controller)
+{
+	if (!Controller) return;
+
+	if (const auto Character = Cast<ACMPCharacter>(Controller->GetPawn()))
+	{
+		Controller->UnPossess();
+
+		if (const auto Pool = UCMPCharacterPoolSubsystem::Get(GetWorld()))
+		{
+			Pool->ReleaseCharacter(Character);
+		}
+		else
+		{
+			Character->Destroy();
+		}
+	}
+
+	RestartPlayer(Controller);
+}
+
+void ACMPGameMode::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (const auto Pool = UCMPCharacterPoolSubsystem::Get(GetWorld()))
+	{
+		Pool->PrewarmCharacters(DefaultPawnClass, PrewarmedCharacters);
+	}
+}
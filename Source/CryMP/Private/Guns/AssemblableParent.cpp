@@ -3,8 +3,8 @@
 
 #include "Guns/AssemblableParent.h"
 
-#include "Kismet/KismetStringLibrary.h"
 #include "Net/UnrealNetwork.h"
+#include "System/CMPSocketClassificationCache.h"
 
 AAssemblableParent::AAssemblableParent()
 {
@@ -37,24 +37,25 @@ void AAssemblableParent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& O
 
 void AAssemblableParent::GenerateAimPoints()
 {
-	if (!HasAuthority()) return;
-
+	// Also on clients, they build sights from these to derive the hand transform
 	const auto MeshComponent = GetComponentByClass<UMeshComponent>();
-	const auto NameOfSockets = MeshComponent->GetAllSocketNames();
-	for (const auto SocketName : NameOfSockets)
+	const auto Cache = UCMPSocketClassificationCache::Get();
+	if (!MeshComponent || !Cache) return;
+
+	FCMPSocketClassification Scratch;
+	const auto& Classification = Cache->Classify(*this, *MeshComponent, Scratch);
+
+	for (const auto SocketName : Classification.OpticAimPoints)
+	{
+		OpticAimPoints.AddUnique(FAimPoint(SocketName, MeshComponent, true));
+	}
+	for (const auto SocketName : Classification.FrontAimPoints)
+	{
+		FrontAimPoints.AddUnique(FAimPoint(SocketName, MeshComponent, true));
+	}
+	for (const auto SocketName : Classification.RearAimPoints)
 	{
-		if (UKismetStringLibrary::StartsWith(SocketName.ToString(), AimPointOpticPrefix, ESearchCase::IgnoreCase))
-		{
-			OpticAimPoints.AddUnique(FAimPoint(SocketName, MeshComponent, true));
-		}
-		else if (UKismetStringLibrary::StartsWith(SocketName.ToString(), AimPointFrontPrefix, ESearchCase::IgnoreCase))
-		{
-			FrontAimPoints.AddUnique(FAimPoint(SocketName, MeshComponent, true));
-		}
-		else if (UKismetStringLibrary::StartsWith(SocketName.ToString(), AimPointRearPrefix, ESearchCase::IgnoreCase))
-		{
-			RearAimPoints.AddUnique(FAimPoint(SocketName, MeshComponent, true));
-		}
+		RearAimPoints.AddUnique(FAimPoint(SocketName, MeshComponent, true));
 	}
 }
 
@@ -63,9 +64,24 @@ void AAssemblableParent::CustomAction(bool IsCustomActioned)
 	
 }
 
+FCMPSocketPrefixes AAssemblableParent::GetSocketPrefixes() const
+{
+	FCMPSocketPrefixes Prefixes;
+	Prefixes.OpticAimPoint = AimPointOpticPrefix;
+	Prefixes.FrontAimPoint = AimPointFrontPrefix;
+	Prefixes.RearAimPoint = AimPointRearPrefix;
+	return Prefixes;
+}
+
 void AAssemblableParent::ApplyMaterial(UMaterialInterface* NewMaterial)
 {
 	Material = NewMaterial;
+
+	// Replicated parts apply it in OnRep_Material on clients, unreplicated ones only exist here
+	if (!GetIsReplicated())
+	{
+		OnRep_Material();
+	}
 }
 
 void AAssemblableParent::OnRep_Material()
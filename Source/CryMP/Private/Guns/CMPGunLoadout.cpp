@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Guns/CMPGunLoadout.h"
+
+#include "Algo/BinarySearch.h"
+#include "Guns/GunParent.h"
+#include "System/CMPSocketClassificationCache.h"
+
+
+namespace
+{
+	// Sorted so the server and every client agree on the index for the same mesh
+	const TArray<FName>& GetSortedSocketNames(const UMeshComponent& Mesh, TArray<FName>& Scratch)
+	{
+		if (const auto Cache = UCMPSocketClassificationCache::Get())
+		{
+			return Cache->GetSortedSocketNames(Mesh, Scratch);
+		}
+
+		Scratch = Mesh.GetAllSocketNames();
+		Scratch.Sort(FNameLexicalLess());
+		return Scratch;
+	}
+}
+
+void FCMPLoadoutPart::PostReplicatedAdd(const FCMPGunLoadout& InArraySerializer)
+{
+	// Parts attached to an assembled gun are added on their own, the initial loadout is built in one go
+	if (!InArraySerializer.Owner || !InArraySerializer.Owner->HasActorBegunPlay() || InArraySerializer.bNeedsRebuild)
+	{
+		InArraySerializer.bNeedsRebuild = true;
+		return;
+	}
+
+	InArraySerializer.Owner->AddLoadoutPart(UE_PTRDIFF_TO_INT32(this - InArraySerializer.Parts.GetData()));
+}
+
+void FCMPLoadoutPart::PostReplicatedChange(const FCMPGunLoadout& InArraySerializer)
+{
+	if (!InArraySerializer.Owner || InArraySerializer.bNeedsRebuild) return;
+
+	InArraySerializer.Owner->ApplyLoadoutPart(UE_PTRDIFF_TO_INT32(this - InArraySerializer.Parts.GetData()));
+}
+
+void FCMPLoadoutPart::PreReplicatedRemove(const FCMPGunLoadout& InArraySerializer)
+{
+	InArraySerializer.bNeedsRebuild = true;
+}
+
+uint16 FCMPGunLoadout::GetSocketId(const UMeshComponent* Mesh, FName SocketName)
+{
+	if (!Mesh || SocketName.IsNone()) return InvalidSocketId;
+
+	TArray<FName> Scratch;
+	const TArray<FName>& SocketNames = GetSortedSocketNames(*Mesh, Scratch);
+
+	const int32 Index = Algo::BinarySearch(SocketNames, SocketName, FNameLexicalLess());
+	return Index != INDEX_NONE && Index < InvalidSocketId ? uint16(Index) : InvalidSocketId;
+}
+
+FName FCMPGunLoadout::GetSocketName(const UMeshComponent* Mesh, uint16 SocketId)
+{
+	if (!Mesh || SocketId == InvalidSocketId) return NAME_None;
+
+	TArray<FName> Scratch;
+	const TArray<FName>& SocketNames = GetSortedSocketNames(*Mesh, Scratch);
+
+	return SocketNames.IsValidIndex(SocketId) ? SocketNames[SocketId] : NAME_None;
+}
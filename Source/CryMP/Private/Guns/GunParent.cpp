@@ -7,8 +7,28 @@
 #include "MagParent.h"
 #include "Guns/GunPartParent.h"
 #include "Kismet/KismetMathLibrary.h"
-#include "Kismet/KismetSystemLibrary.h"
 #include "Net/UnrealNetwork.h"
+#include "System/CMPGunAssemblyCache.h"
+
+
+bool FCMPWeaponViewState::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	// Sight index, fire mode and interpolate flag in one byte
+	uint8 Packed = 0;
+	if (Ar.IsSaving())
+	{
+		Packed = (SightIndex & MaxSightIndex) | ((uint8(FireMode) & 0x03) << SightIndexBits) |
+			(bInterpolateSight ? 0x80 : 0);
+	}
+	Ar << Packed;
+
+	SightIndex = Packed & MaxSightIndex;
+	FireMode = EFireModes((Packed >> SightIndexBits) & 0x03);
+	bInterpolateSight = (Packed & 0x80) != 0;
+
+	bOutSuccess = true;
+	return true;
+}
 
 AGunParent::AGunParent()
 {
@@ -19,6 +39,8 @@ AGunParent::AGunParent()
 	AvailableFireModes.Add(EFireModes::EFM_Semi);
 	AvailableFireModes.Add(EFireModes::EFM_Burst);
 	AvailableFireModes.Add(EFireModes::EFM_Auto);
+
+	Loadout.Owner = this;
 }
 
 void AGunParent::BeginPlay()
@@ -28,15 +50,46 @@ void AGunParent::BeginPlay()
 	if (HasAuthority())
 	{
 		ResetGunProperties();
-		AddStartingParts();
+		if (bReplicateLoadoutAsDescriptor)
+		{
+			BuildLoadoutFromStartingParts();
+			BuildLocalParts();
+		}
+		else
+		{
+			AddStartingParts();
+		}
 		ModifyGunProperties();
 		GenerateSights();
 		SetMagazine();
 
+		if (Magazine)
+		{
+			MagazineAmmo = Magazine->CurrentAmmo;
+		}
+
 		CharacterOwner = Cast<ACMPCharacter>(GetOwner());
+		SetStartingFireMode();
+
+		CacheAssembly();
 	}
+	else if (bReplicateLoadoutAsDescriptor && Loadout.Parts.Num() > 0)
+	{
+		// The initial bunch may have called OnRep_Loadout before BeginPlay
+		Loadout.bNeedsRebuild = false;
+		BuildLocalParts();
+	}
+}
 
-	SetStartingFireMode();
+void AGunParent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Local parts are not owned by the net driver, nothing else would clean them up
+	if (bReplicateLoadoutAsDescriptor)
+	{
+		DestroyLocalParts();
+	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void AGunParent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
@@ -48,6 +101,19 @@ void AGunParent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifeti
 	DOREPLIFETIME_CONDITION(AGunParent, RecoilPerShot, COND_OwnerOnly);
 	DOREPLIFETIME_CONDITION(AGunParent, StartingParts, COND_InitialOnly);
 	DOREPLIFETIME(AGunParent, Magazine);
+	DOREPLIFETIME(AGunParent, Loadout);
+	DOREPLIFETIME_CONDITION(AGunParent, MagazineAmmo, COND_OwnerOnly);
+}
+
+void AGunParent::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// Part actors only exist locally in descriptor mode, clients resolve them from Loadout
+	DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(AGunParent, CurrentParts, !bReplicateLoadoutAsDescriptor);
+	DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(AGunParent, Magazine, !bReplicateLoadoutAsDescriptor);
+	DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(AGunParent, Loadout, bReplicateLoadoutAsDescriptor);
+	DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(AGunParent, MagazineAmmo, bReplicateLoadoutAsDescriptor);
 }
 
 void AGunParent::Equip()
@@ -58,59 +124,93 @@ void AGunParent::UnEquip()
 {
 }
 
-void AGunParent::CalculateHandTransforms()
+void AGunParent::ResetForReuse()
 {
-	const bool bHasSights = Sights.Num() > 0;
+	ResetGunProperties();
+	ModifyGunProperties();
+	SetStartingFireMode();
+	CurrentSight = 0;
+	bIsAiming = false;
 
-	FTransform HandTransform;
-	if (bHasSights)
+	if (Magazine)
 	{
-		UpdateOpticSightsHandTransform();
-		UpdateIronSightsHandTransform();
+		Magazine->ResetAmmo();
+		MagazineAmmo = Magazine->CurrentAmmo;
+	}
+}
 
-		const auto& SightData = Sights.GetData()[CurrentSight];
-		HandTransform = SightData.HandTransform;
+FCMPWeaponViewState AGunParent::MakeViewState() const
+{
+	FCMPWeaponViewState ViewState;
+	ViewState.SightIndex = uint8(FMath::Clamp(CurrentSight, 0, FCMPWeaponViewState::MaxSightIndex));
+	ViewState.FireMode = CurrentFireMode;
+	ViewState.bInterpolateSight = Sights.Num() == 0;
+	return ViewState;
+}
+
+void AGunParent::ApplyViewState(const FCMPWeaponViewState& ViewState)
+{
+	// Clients build the same sights from the replicated parts
+	if (!HasAuthority() && bSightsDirty)
+	{
+		GenerateSights();
 	}
 
-	CharacterOwner->SetInterpolateSight(!bHasSights);
-	CharacterOwner->SetHandTransform(HandTransform);
+	CurrentSight = ViewState.SightIndex;
+	CurrentFireMode = ViewState.FireMode;
 }
 
-void AGunParent::SetStartingFireMode()
+bool AGunParent::CalculateHandTransform(FTransform& OutHandTransform)
 {
-	if (!GetInstigator() || !GetInstigator()->IsLocallyControlled()) return;
+	// CharacterOwner is only set on the server, and clients derive the hand transform as well
+	const auto Character = Cast<ACMPCharacter>(GetOwner());
+	if (!Character || !Sights.IsValidIndex(CurrentSight)) return false;
+
+	const auto ToEquipped = GetToEquippedTransform(*Character);
+	UpdateOpticSightsHandTransform(*Character, ToEquipped);
+	UpdateIronSightsHandTransform(*Character, ToEquipped);
 
+	OutHandTransform = Sights.GetData()[CurrentSight].HandTransform;
+	return true;
+}
+
+void AGunParent::SetStartingFireMode()
+{
 	if (AvailableFireModes.Find(StartingFireMode) != INDEX_NONE)
 	{
 		CurrentFireMode = StartingFireMode;
 		return;
 	}
 
-	const auto ModesNum = AvailableFireModes.Num();
-	CurrentFireMode = AvailableFireModes.GetData()[ModesNum];
+	CurrentFireMode = AvailableFireModes.Num() > 0 ? AvailableFireModes[0] : EFireModes::EFM_Safe;
 }
 
-void AGunParent::UpdateOpticSightsHandTransform()
+FTransform AGunParent::GetToEquippedTransform(const ACMPCharacter& Character) const
+{
+	return GetActorTransform().Inverse() * Character.GetEquippedGunTransform();
+}
+
+void AGunParent::UpdateOpticSightsHandTransform(const ACMPCharacter& Character, const FTransform& ToEquipped)
 {
 	for (auto& Sight : Sights)
 	{
 		if (Sight.SightType != ESightTypes::EST_Optic) continue;
 
-		const auto RightHandTransform = CharacterOwner->GetRightHandTransform(RTS_World);
+		const auto RightHandTransform = Character.GetRightHandTransform(RTS_World);
 		const auto OpticAimPointTransform = Sight.OpticOrFrontComponent->GetSocketTransform(
-			Sight.OpticOrFrontSocket, RTS_World);
+			Sight.OpticOrFrontSocket, RTS_World) * ToEquipped;
 
 		Sight.HandTransform = UKismetMathLibrary::MakeRelativeTransform(RightHandTransform, OpticAimPointTransform);
 	}
 }
 
-void AGunParent::UpdateIronSightsHandTransform()
+void AGunParent::UpdateIronSightsHandTransform(const ACMPCharacter& Character, const FTransform& ToEquipped)
 {
 	for (auto& Sight : Sights)
 	{
 		if (Sight.SightType != ESightTypes::EST_IronSight) continue;
 
-		const auto RightHandTransform = CharacterOwner->GetRightHandTransform(RTS_World);
+		const auto RightHandTransform = Character.GetRightHandTransform(RTS_World);
 		const auto FrontAimPointLocation = Sight.OpticOrFrontComponent->GetSocketLocation(Sight.OpticOrFrontSocket);
 
 		FVector RearAimPointLocation;
@@ -118,7 +218,7 @@ void AGunParent::UpdateIronSightsHandTransform()
 		Sight.RearComponent->GetSocketWorldLocationAndRotation(Sight.RearSocket, RearAimPointLocation,
 		                                                       RearAimPointRotation);
 
-		const auto IronSightTransform = CalculateIronSightTransform(FrontAimPointLocation, RearAimPointLocation, RearAimPointRotation);
+		const auto IronSightTransform = CalculateIronSightTransform(FrontAimPointLocation, RearAimPointLocation, RearAimPointRotation) * ToEquipped;
 		
 		Sight.HandTransform = UKismetMathLibrary::MakeRelativeTransform(RightHandTransform, IronSightTransform);
 	}
@@ -156,45 +256,439 @@ void AGunParent::ResetGunProperties()
 
 void AGunParent::AddStartingParts()
 {
+	const auto Assembly = FindCachedAssembly();
+
+	for (const auto& Part : StartingParts)
+	{
+		const int32 PartIndex = CurrentParts.Num();
+		const auto RelativeTransform = Assembly && Assembly->PartTransforms.IsValidIndex(PartIndex)
+			                               ? &Assembly->PartTransforms[PartIndex]
+			                               : nullptr;
+
+		// Keeps indices in step with StartingParts when a part class is missing
+		CurrentParts.Add(SpawnPart(Part.PartClass, Part.BaseSocket, Part.Actioned, nullptr, true, RelativeTransform));
+		LinkPart(PartIndex, Part.BaseIndex);
+	}
+}
+
+void AGunParent::BuildLoadoutFromStartingParts()
+{
+	Loadout.Parts.Reset();
+
 	for (const auto& Part : StartingParts)
 	{
-		AActor* BaseActor = this;
-		if (Part.BaseIndex != -1)
+		FCMPLoadoutPart& Entry = Loadout.Parts.AddDefaulted_GetRef();
+		Entry.PartClass = Part.PartClass;
+		Entry.BaseIndex = int8(FMath::Clamp(Part.BaseIndex, -1, int32(MAX_int8)));
+		Entry.SocketId = FCMPGunLoadout::GetSocketId(WeaponMesh, Part.BaseSocket);
+		Entry.bActioned = Part.Actioned;
+	}
+
+	Loadout.MarkArrayDirty();
+}
+
+void AGunParent::BuildLocalParts()
+{
+	DestroyLocalParts();
+
+	const auto Assembly = FindCachedAssembly();
+
+	for (int32 PartIndex = 0; PartIndex < Loadout.Parts.Num(); PartIndex++)
+	{
+		const auto& Entry = Loadout.Parts[PartIndex];
+		const FName BaseSocket = FCMPGunLoadout::GetSocketName(WeaponMesh, Entry.SocketId);
+		const auto RelativeTransform = Assembly && Assembly->PartTransforms.IsValidIndex(PartIndex)
+			                               ? &Assembly->PartTransforms[PartIndex]
+			                               : nullptr;
+
+		// Keeps indices in step with the loadout when a part class failed to load
+		CurrentParts.Add(SpawnPart(Entry.PartClass, BaseSocket, Entry.bActioned, Entry.Skin, false,
+		                           RelativeTransform));
+		LinkPart(PartIndex, Entry.BaseIndex);
+	}
+
+	SetMagazine();
+	if (Magazine && !HasAuthority())
+	{
+		Magazine->CurrentAmmo = MagazineAmmo;
+	}
+
+	// The parts are complete right away here, unlike replicated ones
+	if (!HasAuthority())
+	{
+		GenerateSights();
+		CacheAssembly();
+		RefreshOwnerViewState();
+	}
+}
+
+void AGunParent::DestroyLocalParts()
+{
+	for (const auto Part : CurrentParts)
+	{
+		if (IsValid(Part))
 		{
-			BaseActor = CurrentParts.GetData()[Part.BaseIndex];
+			Part->Destroy();
 		}
+	}
 
-		FActorSpawnParameters Params;
-		Params.Owner = this;
-		Params.TransformScaleMethod = ESpawnActorScaleMethod::SelectDefaultAtRuntime;
+	CurrentParts.Reset();
+	PartNodes.Reset();
+	Magazine = nullptr;
+}
+
+AGunPartParent* AGunParent::SpawnPart(TSubclassOf<AGunPartParent> PartClass, FName BaseSocket, bool bActioned,
+                                      UMaterialInterface* Skin, bool bReplicated, const FTransform* RelativeTransform)
+{
+	if (!PartClass) return nullptr;
+
+	FActorSpawnParameters Params;
+	Params.Owner = this;
+	Params.TransformScaleMethod = ESpawnActorScaleMethod::SelectDefaultAtRuntime;
+	Params.bDeferConstruction = true;
+
+	const auto GunPart = GetWorld()->SpawnActor<AGunPartParent>(
+		PartClass.Get(),
+		FVector::ZeroVector, FRotator::ZeroRotator, Params);
+	if (!GunPart) return nullptr;
+
+	GunPart->SetReplicates(bReplicated);
+	GunPart->FinishSpawning(FTransform::Identity);
+
+	CustomizePart(GunPart, bActioned);
+	if (Skin)
+	{
+		GunPart->ApplyMaterial(Skin);
+	}
+
+	const FAttachmentTransformRules Rules(
+		EAttachmentRule::SnapToTarget,
+		EAttachmentRule::SnapToTarget,
+		EAttachmentRule::KeepRelative,
+		true);
+
+	GunPart->AttachToComponent(WeaponMesh, Rules, BaseSocket);
+
+	if (RelativeTransform)
+	{
+		GunPart->GetRootComponent()->SetRelativeTransform(*RelativeTransform);
+		return GunPart;
+	}
+
+	FName TopSocket = "None";
+	UMeshComponent* MeshComp;
+	GunPart->FindTopSocket(TopSocket, MeshComp);
+
+	const auto GunPartMesh = GunPart->GetComponentByClass<UMeshComponent>();
+	AdjustRotation(GunPart, GunPartMesh, TopSocket);
+	AdjustLocation(GunPart, GunPartMesh, TopSocket, WeaponMesh, BaseSocket);
+
+	return GunPart;
+}
+
+void AGunParent::SetMagazineAmmo(int32 Ammo)
+{
+	if (!HasAuthority() || !Magazine) return;
+
+	Magazine->CurrentAmmo = Ammo;
+	MagazineAmmo = Ammo;
+}
+
+int32 AGunParent::GetAmmo() const
+{
+	if (!Magazine) return 0;
+
+	// Only the owner receives the ammo, in descriptor mode as MagazineAmmo
+	return HasAuthority() || !bReplicateLoadoutAsDescriptor ? Magazine->CurrentAmmo : MagazineAmmo;
+}
+
+bool AGunParent::ConsumeAmmo()
+{
+	const int32 Ammo = GetAmmo();
+	if (Ammo <= 0) return false;
+
+	if (HasAuthority())
+	{
+		SetMagazineAmmo(Ammo - 1);
+	}
+	else
+	{
+		// Replaced by the server value once the shot was validated
+		Magazine->CurrentAmmo = Ammo - 1;
+		MagazineAmmo = Ammo - 1;
+	}
+	return true;
+}
+
+void AGunParent::SetPartSkin(int32 PartIndex, UMaterialInterface* Skin)
+{
+	if (!HasAuthority() || !CurrentParts.IsValidIndex(PartIndex)) return;
+
+	if (bReplicateLoadoutAsDescriptor && Loadout.Parts.IsValidIndex(PartIndex))
+	{
+		Loadout.Parts[PartIndex].Skin = Skin;
+		Loadout.MarkItemDirty(Loadout.Parts[PartIndex]);
+		ApplyLoadoutPart(PartIndex);
+		return;
+	}
+
+	if (CurrentParts[PartIndex])
+	{
+		CurrentParts[PartIndex]->ApplyMaterial(Skin);
+	}
+}
 
-		const auto GunPart = GetWorld()->SpawnActor<AGunPartParent>(
-			Part.PartClass.Get(),
-			FVector::ZeroVector, FRotator::ZeroRotator, Params);
+void AGunParent::ServerPartAction_Implementation(uint8 PartIndex)
+{
+	if (!CurrentParts.IsValidIndex(PartIndex) || !CurrentParts[PartIndex]) return;
+
+	if (bReplicateLoadoutAsDescriptor && Loadout.Parts.IsValidIndex(PartIndex))
+	{
+		Loadout.Parts[PartIndex].bActioned = !Loadout.Parts[PartIndex].bActioned;
+		Loadout.MarkItemDirty(Loadout.Parts[PartIndex]);
+		ApplyLoadoutPart(PartIndex);
+		return;
+	}
 
-		CustomizePart(GunPart, Part.Actioned);
+	const auto Part = CurrentParts[PartIndex];
+	CustomizePart(Part, !Part->bIsCustomActioned);
+}
 
-		const FAttachmentTransformRules Rules(
-			EAttachmentRule::SnapToTarget,
-			EAttachmentRule::SnapToTarget,
-			EAttachmentRule::KeepRelative,
-			true);
+void AGunParent::ApplyLoadoutPart(int32 PartIndex)
+{
+	if (!Loadout.Parts.IsValidIndex(PartIndex) || !CurrentParts.IsValidIndex(PartIndex)) return;
 
-		GunPart->AttachToComponent(WeaponMesh, Rules, Part.BaseSocket);
-		CurrentParts.AddUnique(GunPart);
+	const auto Part = CurrentParts[PartIndex];
+	if (!Part) return;
 
-		FName TopSocket = "None";
-		UMeshComponent* MeshComp;
-		GunPart->FindTopSocket(TopSocket, MeshComp);
+	const auto& Entry = Loadout.Parts[PartIndex];
 
-		const auto GunPartMesh = GunPart->GetComponentByClass<UMeshComponent>();
-		AdjustRotation(GunPart, GunPartMesh, TopSocket);
-		AdjustLocation(GunPart, GunPartMesh, TopSocket, WeaponMesh, Part.BaseSocket);
+	// The server empties the entries of detached parts
+	if (!Entry.PartClass)
+	{
+		RemovePartSubtree(PartIndex);
+		return;
+	}
+
+	CustomizePart(Part, Entry.bActioned);
+	Part->ApplyMaterial(Entry.Skin);
+}
+
+void AGunParent::AddLoadoutPart(int32 PartIndex)
+{
+	// Anything but the next entry in order means the local parts are out of step with the loadout
+	if (!Loadout.Parts.IsValidIndex(PartIndex) || CurrentParts.Num() != PartIndex)
+	{
+		Loadout.bNeedsRebuild = true;
+		return;
+	}
+
+	const auto& Entry = Loadout.Parts[PartIndex];
+	const FName BaseSocket = FCMPGunLoadout::GetSocketName(WeaponMesh, Entry.SocketId);
+
+	CurrentParts.Add(SpawnPart(Entry.PartClass, BaseSocket, Entry.bActioned, Entry.Skin, false, nullptr));
+	LinkPart(PartIndex, Entry.BaseIndex);
+	OnPartAttached(PartIndex);
+}
+
+int32 AGunParent::AttachPart(TSubclassOf<AGunPartParent> PartClass, int32 BaseIndex, FName BaseSocket, bool bActioned)
+{
+	if (!HasAuthority() || !PartClass) return INDEX_NONE;
+
+	const int32 ParentIndex = CurrentParts.IsValidIndex(BaseIndex) && CurrentParts[BaseIndex] ? BaseIndex : INDEX_NONE;
+
+	const auto Part = SpawnPart(PartClass, BaseSocket, bActioned, nullptr, !bReplicateLoadoutAsDescriptor, nullptr);
+	if (!Part) return INDEX_NONE;
+
+	const int32 PartIndex = CurrentParts.Add(Part);
+
+	if (bReplicateLoadoutAsDescriptor)
+	{
+		FCMPLoadoutPart& Entry = Loadout.Parts.AddDefaulted_GetRef();
+		Entry.PartClass = PartClass;
+		Entry.BaseIndex = int8(FMath::Clamp(ParentIndex, -1, int32(MAX_int8)));
+		Entry.SocketId = FCMPGunLoadout::GetSocketId(WeaponMesh, BaseSocket);
+		Entry.bActioned = bActioned;
+		Loadout.MarkItemDirty(Entry);
+	}
+
+	LinkPart(PartIndex, ParentIndex);
+	OnPartAttached(PartIndex);
+	return PartIndex;
+}
+
+void AGunParent::DetachPart(int32 PartIndex)
+{
+	if (!HasAuthority() || !CurrentParts.IsValidIndex(PartIndex) || !CurrentParts[PartIndex]) return;
+
+	if (bReplicateLoadoutAsDescriptor)
+	{
+		TArray<int32> Subtree;
+		GetPartSubtree(PartIndex, Subtree);
+
+		// Entries are emptied rather than removed, the ones after them keep their index
+		for (const int32 Index : Subtree)
+		{
+			if (!Loadout.Parts.IsValidIndex(Index)) continue;
+
+			Loadout.Parts[Index].PartClass = nullptr;
+			Loadout.Parts[Index].Skin = nullptr;
+			Loadout.MarkItemDirty(Loadout.Parts[Index]);
+		}
+	}
+
+	RemovePartSubtree(PartIndex);
+}
+
+void AGunParent::LinkPart(int32 PartIndex, int32 ParentIndex)
+{
+	if (PartNodes.Num() <= PartIndex)
+	{
+		PartNodes.SetNum(PartIndex + 1);
+	}
+
+	const bool bHasParent = ParentIndex != PartIndex && PartNodes.IsValidIndex(ParentIndex);
+	PartNodes[PartIndex].ParentIndex = bHasParent ? ParentIndex : INDEX_NONE;
+	if (bHasParent)
+	{
+		PartNodes[ParentIndex].Children.AddUnique(PartIndex);
+	}
+}
+
+void AGunParent::GetPartSubtree(int32 PartIndex, TArray<int32>& OutSubtree) const
+{
+	if (!PartNodes.IsValidIndex(PartIndex) || OutSubtree.Contains(PartIndex)) return;
+
+	OutSubtree.Add(PartIndex);
+	for (const int32 ChildIndex : PartNodes[PartIndex].Children)
+	{
+		GetPartSubtree(ChildIndex, OutSubtree);
+	}
+}
+
+void AGunParent::OnPartAttached(int32 PartIndex)
+{
+	bHasRuntimeParts = true;
+
+	const auto Part = CurrentParts[PartIndex];
+	if (!Part) return;
+
+	// The owner receives the server's replicated stats, adding here too would count the part twice
+	if (HasAuthority())
+	{
+		SpreadAiming += Part->AddSpreadAiming;
+		SpreadHip += Part->AddSpreadHip;
+		RecoilPerShot += Part->AddRecoilPerShot;
+	}
+
+	RegenerateSights();
+
+	if (Part->IsA<AMagParent>())
+	{
+		SetMagazine();
+	}
+
+	RefreshOwnerViewState();
+}
+
+void AGunParent::RemovePartSubtree(int32 PartIndex)
+{
+	if (!CurrentParts.IsValidIndex(PartIndex) || !CurrentParts[PartIndex]) return;
+
+	bHasRuntimeParts = true;
+
+	TArray<int32> Subtree;
+	GetPartSubtree(PartIndex, Subtree);
+
+	TSet<const AActor*> RemovedParts;
+	for (const int32 Index : Subtree)
+	{
+		const auto Part = CurrentParts.IsValidIndex(Index) ? CurrentParts[Index] : nullptr;
+		if (!Part) continue;
+
+		if (HasAuthority())
+		{
+			SpreadAiming -= Part->AddSpreadAiming;
+			SpreadHip -= Part->AddSpreadHip;
+			RecoilPerShot -= Part->AddRecoilPerShot;
+		}
+		RemovedParts.Add(Part);
+	}
+
+	const bool bRemovedMagazine = RemovedParts.Contains(Magazine);
+
+	const int32 ParentIndex = PartNodes.IsValidIndex(PartIndex) ? PartNodes[PartIndex].ParentIndex : INDEX_NONE;
+	if (PartNodes.IsValidIndex(ParentIndex))
+	{
+		PartNodes[ParentIndex].Children.Remove(PartIndex);
+	}
+
+	for (const int32 Index : Subtree)
+	{
+		if (IsValid(CurrentParts[Index]))
+		{
+			CurrentParts[Index]->Destroy();
+		}
+		CurrentParts[Index] = nullptr;
+		PartNodes[Index] = FCMPGunPartNode();
+	}
+
+	RegenerateSights();
+
+	if (bRemovedMagazine)
+	{
+		SetMagazine();
+		if (HasAuthority())
+		{
+			MagazineAmmo = Magazine ? Magazine->CurrentAmmo : 0;
+		}
+	}
+
+	RefreshOwnerViewState();
+}
+
+void AGunParent::RegenerateSights()
+{
+	const FSightData PreviousSight = Sights.IsValidIndex(CurrentSight) ? Sights[CurrentSight] : FSightData();
+
+	// Clients build the whole list in part order, so the server does too for SightIndex to mean the same sight
+	GenerateSights();
+
+	CurrentSight = FMath::Max(0, Sights.IndexOfByPredicate([&PreviousSight](const FSightData& Sight)
+	{
+		return Sight.SightType == PreviousSight.SightType &&
+			Sight.OpticOrFrontComponent == PreviousSight.OpticOrFrontComponent &&
+			Sight.OpticOrFrontSocket == PreviousSight.OpticOrFrontSocket &&
+			Sight.RearComponent == PreviousSight.RearComponent && Sight.RearSocket == PreviousSight.RearSocket;
+	}));
+}
+
+void AGunParent::RefreshOwnerViewState()
+{
+	// CharacterOwner is only set on the server
+	const auto Character = Cast<ACMPCharacter>(GetOwner());
+	if (!Character || Character->GetCurrentWeapon() != this) return;
+
+	if (HasAuthority())
+	{
+		Character->SetWeaponViewState(MakeViewState());
+	}
+	else
+	{
+		Character->RefreshWeaponViewState();
 	}
 }
 
 void AGunParent::ModifyGunProperties()
 {
+	if (const auto Assembly = FindCachedAssembly())
+	{
+		SpreadAiming += Assembly->AddSpreadAiming;
+		SpreadHip += Assembly->AddSpreadHip;
+		RecoilPerShot += Assembly->AddRecoilPerShot;
+		return;
+	}
+
 	const auto GunParts = GetAttachedPartsRecursevely();
 	for (const auto& GunPart : GunParts)
 	{
@@ -206,6 +700,11 @@ void AGunParent::ModifyGunProperties()
 
 void AGunParent::GenerateSights()
 {
+	bSightsDirty = false;
+
+	const auto Assembly = FindCachedAssembly();
+	if (Assembly && ResolveCachedSights(*Assembly)) return;
+
 	Sights.Reset();
 	CurrentSight = 0;
 
@@ -219,6 +718,124 @@ void AGunParent::GenerateSights()
 	}
 }
 
+FCMPGunAssemblyKey AGunParent::MakeAssemblyKey() const
+{
+	TArray<FCMPGunAssemblyPart> Parts;
+
+	if (bReplicateLoadoutAsDescriptor)
+	{
+		for (const auto& Entry : Loadout.Parts)
+		{
+			FCMPGunAssemblyPart& Part = Parts.AddDefaulted_GetRef();
+			Part.PartClass = Entry.PartClass.Get();
+			Part.BaseIndex = Entry.BaseIndex;
+			Part.BaseSocket = FCMPGunLoadout::GetSocketName(WeaponMesh, Entry.SocketId);
+			Part.bActioned = Entry.bActioned;
+		}
+	}
+	else
+	{
+		for (const auto& StartingPart : StartingParts)
+		{
+			FCMPGunAssemblyPart& Part = Parts.AddDefaulted_GetRef();
+			Part.PartClass = StartingPart.PartClass.Get();
+			Part.BaseIndex = StartingPart.BaseIndex;
+			Part.BaseSocket = StartingPart.BaseSocket;
+			Part.bActioned = StartingPart.Actioned;
+		}
+	}
+
+	return FCMPGunAssemblyKey(GetClass(), MoveTemp(Parts));
+}
+
+const FCMPGunAssembly* AGunParent::FindCachedAssembly() const
+{
+	// The loadout still describes the parts in descriptor mode, StartingParts no longer does
+	if (bHasRuntimeParts && !bReplicateLoadoutAsDescriptor) return nullptr;
+
+	const auto Cache = UCMPGunAssemblyCache::Get(this);
+	return Cache ? Cache->Find(MakeAssemblyKey()) : nullptr;
+}
+
+void AGunParent::CacheAssembly() const
+{
+	if (bHasRuntimeParts && !bReplicateLoadoutAsDescriptor) return;
+
+	const auto Cache = UCMPGunAssemblyCache::Get(this);
+	if (!Cache) return;
+
+	FCMPGunAssemblyKey Key = MakeAssemblyKey();
+	if (Cache->Find(Key)) return;
+
+	FCMPGunAssembly Assembly;
+
+	for (const auto Part : CurrentParts)
+	{
+		Assembly.PartTransforms.Add(Part ? Part->GetRootComponent()->GetRelativeTransform() : FTransform::Identity);
+	}
+
+	for (const auto& GunPart : GetAttachedPartsRecursevely())
+	{
+		Assembly.AddSpreadAiming += GunPart->AddSpreadAiming;
+		Assembly.AddSpreadHip += GunPart->AddSpreadHip;
+		Assembly.AddRecoilPerShot += GunPart->AddRecoilPerShot;
+	}
+
+	// Index of the part that owns a component, INDEX_NONE for the gun itself
+	auto GetOwnerIndex = [this](const UMeshComponent* Component, int32& OutIndex)
+	{
+		const AActor* Owner = Component ? Component->GetOwner() : nullptr;
+		OutIndex = CurrentParts.IndexOfByPredicate([Owner](const AGunPartParent* Part) { return Part == Owner; });
+		return Owner == this || OutIndex != INDEX_NONE;
+	};
+
+	for (const auto& Sight : Sights)
+	{
+		FCMPCachedSight& CachedSight = Assembly.Sights.AddDefaulted_GetRef();
+		CachedSight.SightType = Sight.SightType;
+		CachedSight.OpticOrFrontSocket = Sight.OpticOrFrontSocket;
+		CachedSight.RearSocket = Sight.RearSocket;
+
+		// Sights on something outside the part list cannot be resolved by other instances
+		if (!GetOwnerIndex(Sight.OpticOrFrontComponent, CachedSight.OpticOrFrontOwner)) return;
+		if (Sight.SightType == ESightTypes::EST_IronSight && !GetOwnerIndex(Sight.RearComponent, CachedSight.RearOwner)) return;
+	}
+
+	Cache->Add(MoveTemp(Key), MoveTemp(Assembly));
+}
+
+bool AGunParent::ResolveCachedSights(const FCMPGunAssembly& Assembly)
+{
+	auto GetMeshComponent = [this](int32 OwnerIndex) -> UMeshComponent*
+	{
+		const AAssemblableParent* Part = OwnerIndex == INDEX_NONE
+			                                 ? this
+			                                 : CurrentParts.IsValidIndex(OwnerIndex) ? CurrentParts[OwnerIndex] : nullptr;
+		return Part ? Part->GetComponentByClass<UMeshComponent>() : nullptr;
+	};
+
+	TArray<FSightData> ResolvedSights;
+	for (const auto& CachedSight : Assembly.Sights)
+	{
+		FSightData& Sight = ResolvedSights.AddDefaulted_GetRef();
+		Sight.SightType = CachedSight.SightType;
+		Sight.OpticOrFrontSocket = CachedSight.OpticOrFrontSocket;
+		Sight.OpticOrFrontComponent = GetMeshComponent(CachedSight.OpticOrFrontOwner);
+		if (!Sight.OpticOrFrontComponent) return false;
+
+		if (Sight.SightType == ESightTypes::EST_IronSight)
+		{
+			Sight.RearSocket = CachedSight.RearSocket;
+			Sight.RearComponent = GetMeshComponent(CachedSight.RearOwner);
+			if (!Sight.RearComponent) return false;
+		}
+	}
+
+	Sights = MoveTemp(ResolvedSights);
+	CurrentSight = 0;
+	return true;
+}
+
 void AGunParent::SetMagazine()
 {
 	for (const auto Part : CurrentParts)
@@ -286,7 +903,8 @@ void AGunParent::GenerateIronSights(AAssemblableParent* InPart, const TArray<AAs
 	{
 		const bool bIsAimPointWithinMaxAngle = IsAimPointWithinMaxAngle(FrontAimPoint.MeshComponent,
 		                                                                FrontAimPoint.Socket);
-		if (bIsAimPointWithinMaxAngle && FrontAimPoint.bInUse)
+		if (bIsAimPointWithinMaxAngle && FrontAimPoint.bInUse &&
+			!HasIronSightForFront(FrontAimPoint.MeshComponent, FrontAimPoint.Socket))
 		{
 			for (const auto Part : AllParts)
 			{
@@ -338,56 +956,68 @@ bool AGunParent::IsAimPointWithinMaxAngle(UMeshComponent* MeshComponent, FName S
 	return UKismetMathLibrary::DegAcos(VectorsDot) < SightMaxAngle;
 }
 
-void AGunParent::GetAllParts(TArray<AAssemblableParent*>& AllParts) const
+void AGunParent::GetAllParts(TArray<AAssemblableParent*>& AllParts)
 {
-	TArray<UPrimitiveComponent*> AllPrimitiveComponents;
-	AllPrimitiveComponents.AddUnique(WeaponMesh);
-
-	TArray<USceneComponent*> MeshChilds;
-	WeaponMesh->GetChildrenComponents(true, MeshChilds);
+	AllParts.Reset(CurrentParts.Num() + 1);
+	AllParts.Add(this);
 
-	for (const auto MeshChild : MeshChilds)
+	for (const auto Part : CurrentParts)
 	{
-		if (const auto PrimComp = Cast<UPrimitiveComponent>(MeshChild))
+		if (Part)
 		{
-			AllPrimitiveComponents.AddUnique(PrimComp);
+			AllParts.Add(Part);
 		}
 	}
+}
 
-	TArray<AActor*> Actors;
-	UKismetSystemLibrary::GetActorListFromComponentList(AllPrimitiveComponents, AAssemblableParent::StaticClass(),
-	                                                    Actors);
+TArray<AGunPartParent*> AGunParent::GetAttachedPartsRecursevely() const
+{
+	TArray<AGunPartParent*> Parts;
+	Parts.Reserve(CurrentParts.Num());
 
-	for (const auto Actor : Actors)
+	for (const auto Part : CurrentParts)
 	{
-		if (const auto Part = Cast<AAssemblableParent>(Actor))
+		if (Part)
 		{
-			AllParts.AddUnique(Part);
+			Parts.Add(Part);
 		}
 	}
-}
-
-TArray<AGunPartParent*> AGunParent::GetAttachedPartsRecursevely()
-{
-	TArray<AGunPartParent*> Parts;
-	GetAttachedInternalLoop(this, Parts);
 	return Parts;
 }
 
-void AGunParent::GetAttachedInternalLoop(const AAssemblableParent* Part, TArray<AGunPartParent*>& Parts) const
+bool AGunParent::HasIronSightForFront(const UMeshComponent* FrontComponent, FName FrontSocket) const
 {
-	TArray<AActor*> Actors;
-	Part->GetAttachedActors(Actors);
-	for (const auto Actor : Actors)
+	return Sights.ContainsByPredicate([FrontComponent, FrontSocket](const FSightData& Sight)
 	{
-		if (auto GunPart = Cast<AGunPartParent>(Actor))
-		{
-			Parts.AddUnique(GunPart);
-			GetAttachedInternalLoop(GunPart, Parts);
-		}
-	}
+		return Sight.SightType == ESightTypes::EST_IronSight && Sight.OpticOrFrontComponent == FrontComponent &&
+			Sight.OpticOrFrontSocket == FrontSocket;
+	});
 }
 
 void AGunParent::OnRep_CurrentParts()
 {
+	// Also called again as part actors arrive on their own channels, usually after the view state of the owner
+	bSightsDirty = true;
+
+	// Clients only enumerate the parts, where each one is mounted stays on the server
+	PartNodes.Reset();
+	PartNodes.SetNum(CurrentParts.Num());
+
+	RefreshOwnerViewState();
+}
+
+void AGunParent::OnRep_Loadout()
+{
+	if (!Loadout.bNeedsRebuild || !HasActorBegunPlay()) return;
+
+	Loadout.bNeedsRebuild = false;
+	BuildLocalParts();
+}
+
+void AGunParent::OnRep_MagazineAmmo()
+{
+	if (Magazine)
+	{
+		Magazine->CurrentAmmo = MagazineAmmo;
+	}
 }
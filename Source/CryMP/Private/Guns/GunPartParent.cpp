@@ -2,35 +2,25 @@
 
 
 #include "Guns/GunPartParent.h"
-#include "Kismet/KismetStringLibrary.h"
 
+#include "System/CMPSocketClassificationCache.h"
+
+
+FCMPSocketPrefixes AGunPartParent::GetSocketPrefixes() const
+{
+	FCMPSocketPrefixes Prefixes = Super::GetSocketPrefixes();
+	Prefixes.Top = TopPrefix;
+	return Prefixes;
+}
 
 void AGunPartParent::FindTopSocket(FName& OutSocketName, UMeshComponent*& OutMeshComponent) const
 {
 	OutMeshComponent = GetComponentByClass<UMeshComponent>();
-	const auto SocketNames = OutMeshComponent->GetAllSocketNames();
-
 	OutSocketName = "None";
-	for (const auto SocketName : SocketNames)
-	{
-		if (UKismetStringLibrary::StartsWith(SocketName.ToString(), TopPrefix))
-		{
-			OutSocketName = SocketName;
-			return;
-		}
-	}
-}
 
-void AGunPartParent::GetAttachedInternalLoop(const AAssemblableParent* Part, TArray<AGunPartParent*>& Parts) const
-{
-	TArray<AActor*> Actors;
-	Part->GetAttachedActors(Actors);
-	for (const auto Actor : Actors)
-	{
-		if (auto GunPart = Cast<AGunPartParent>(Actor))
-		{
-			Parts.AddUnique(GunPart);
-			GetAttachedInternalLoop(GunPart, Parts);
-		}
-	}
+	const auto Cache = UCMPSocketClassificationCache::Get();
+	if (!OutMeshComponent || !Cache) return;
+
+	FCMPSocketClassification Scratch;
+	OutSocketName = Cache->Classify(*this, *OutMeshComponent, Scratch).TopSocket;
 }
@@ -11,10 +11,15 @@ void AMagParent::BeginPlay()
 
 	if(HasAuthority())
 	{
-		CurrentAmmo = MagSize + 1;
+		ResetAmmo();
 	}
 }
 
+void AMagParent::ResetAmmo()
+{
+	CurrentAmmo = MagSize + 1;
+}
+
 void AMagParent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
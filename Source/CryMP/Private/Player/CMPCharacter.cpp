@@ -6,63 +6,149 @@
 #include "EnhancedInputSubsystems.h"
 #include "Anim/CMPAnimInstance.h"
 #include "Camera/CameraComponent.h"
+#include "Engine/NetConnection.h"
+#include "Engine/PackageMapClient.h"
 #include "Guns/GunParent.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Net/UnrealNetwork.h"
 #include "Player/CMPCharacterMovementComponent.h"
+#include "Player/CMPWeaponFireComponent.h"
+#include "System/CMPReplicationGraph.h"
+#include "System/CMPSignificanceManager.h"
 
 
-FSharedRepMovement::FSharedRepMovement()
+namespace CryMP::RepGraph
 {
-	RepMovement.LocationQuantizationLevel = EVectorQuantization::RoundTwoDecimals;
+	// How many FastShared sends are delta encoded against a keyframe before the next keyframe goes out.
+	int32 FastSharedKeyframeInterval = 8;
+	static FAutoConsoleVariableRef CVarCryMPRepFastSharedKeyframeInterval(TEXT("CryMP.RepGraph.FastSharedKeyframeInterval"), FastSharedKeyframeInterval, TEXT("FastShared movement sends between two full keyframes. 0 sends every update as a keyframe."), ECVF_Default);
+
+	// Keyframe ids wrap after 256 keyframes, which takes the server well over this at one FastShared send per frame
+	float MaxSharedKeyframeAge = 1.f;
+	static FAutoConsoleVariableRef CVarCryMPRepMaxSharedKeyframeAge(TEXT("CryMP.RepGraph.MaxSharedKeyframeAge"), MaxSharedKeyframeAge, TEXT("Seconds without FastShared movement after which a client drops its keyframe and waits for the next one."), ECVF_Default);
 }
 
-bool FSharedRepMovement::FillForCharacter(ACharacter* Character)
+namespace
 {
-	if (USceneComponent* PawnRootComponent = Character->GetRootComponent())
+	// Deltas beyond this are cheaper to send as a keyframe
+	constexpr int32 MaxSharedDeltaUnits = 1 << 20;
+
+	FIntVector ToQuantizedUnits(const FVector& Value, double Scale)
 	{
-		UCharacterMovementComponent* CharacterMovement = Character->GetCharacterMovement();
+		return FIntVector(FMath::RoundToInt(Value.X * Scale), FMath::RoundToInt(Value.Y * Scale),
+		                  FMath::RoundToInt(Value.Z * Scale));
+	}
 
-		RepMovement.Location = FRepMovement::RebaseOntoZeroOrigin(PawnRootComponent->GetComponentLocation(), Character);
-		RepMovement.Rotation = PawnRootComponent->GetComponentRotation();
-		RepMovement.LinearVelocity = CharacterMovement->Velocity;
-		RepMovementMode = CharacterMovement->PackNetworkMovementMode();
-		bProxyIsJumpForceApplied = Character->bProxyIsJumpForceApplied || (Character->JumpForceTimeRemaining > 0.0f);
-		bIsCrouched = Character->bIsCrouched;
+	bool IsDeltaInRange(const FIntVector& Delta)
+	{
+		return FMath::Abs(Delta.X) < MaxSharedDeltaUnits && FMath::Abs(Delta.Y) < MaxSharedDeltaUnits &&
+			FMath::Abs(Delta.Z) < MaxSharedDeltaUnits;
+	}
 
-		// Timestamp is sent as zero if unused
-		if ((CharacterMovement->NetworkSmoothingMode == ENetworkSmoothingMode::Linear) || CharacterMovement->bNetworkAlwaysReplicateTransformUpdateTimestamp)
-		{
-			RepTimeStamp = CharacterMovement->GetServerLastTransformUpdateTimeStamp();
-		}
-		else
+	void SerializeSignedPacked(FArchive& Ar, int32& Value)
+	{
+		// Zig-zag so small negative values pack as small as positive ones
+		uint32 Encoded = (uint32(Value) << 1) ^ uint32(Value >> 31);
+		Ar.SerializeIntPacked(Encoded);
+		if (Ar.IsLoading())
 		{
-			RepTimeStamp = 0.f;
+			Value = int32(Encoded >> 1) ^ -int32(Encoded & 1);
 		}
+	}
 
-		return true;
+	void SerializeSignedPacked(FArchive& Ar, FIntVector& Value)
+	{
+		SerializeSignedPacked(Ar, Value.X);
+		SerializeSignedPacked(Ar, Value.Y);
+		SerializeSignedPacked(Ar, Value.Z);
 	}
-	return false;
 }
 
-bool FSharedRepMovement::Equals(const FSharedRepMovement& Other, ACharacter* Character) const
+void FCMPReplicatedAcceleration::Pack(const FVector& Acceleration, double MaxAcceleration)
+{
+	// Compress Acceleration: XY components as direction + magnitude, Z component as direct value
+	double XYRadians, XYMagnitude;
+	FMath::CartesianToPolar(Acceleration.X, Acceleration.Y, XYMagnitude, XYRadians);
+	if (XYRadians < 0.0) XYRadians += TWO_PI;
+
+	const double InvMaxAcceleration = MaxAcceleration > 0.0 ? 1.0 / MaxAcceleration : 0.0;
+
+	AccelXYRadians = FMath::FloorToInt((XYRadians / TWO_PI) * 255.0);
+	// [0, 2PI] -> [0, 255]
+	AccelXYMagnitude = FMath::Min(FMath::FloorToInt(XYMagnitude * InvMaxAcceleration * 255.0), 255);
+	// [0, MaxAccel] -> [0, 255]
+	AccelZ = FMath::Clamp(FMath::FloorToInt(Acceleration.Z * InvMaxAcceleration * 127.0), -127, 127);
+	// [-MaxAccel, MaxAccel] -> [-127, 127]
+}
+
+FVector FCMPReplicatedAcceleration::Unpack(double MaxAcceleration) const
+{
+	const double XYMagnitude = double(AccelXYMagnitude) * MaxAcceleration / 255.0;
+	// [0, 255] -> [0, MaxAccel]
+	const double XYRadians = double(AccelXYRadians) * TWO_PI / 255.0;
+	// [0, 255] -> [0, 2PI]
+
+	FVector Result(FVector::ZeroVector);
+	FMath::PolarToCartesian(XYMagnitude, XYRadians, Result.X, Result.Y);
+	Result.Z = double(AccelZ) * MaxAcceleration / 127.0;
+	// [-127, 127] -> [-MaxAccel, MaxAccel]
+
+	return Result;
+}
+
+bool FCMPCharacterRepMovement::FillForCharacter(ACharacter* Character)
+{
+	USceneComponent* PawnRootComponent = Character->GetRootComponent();
+	if (!PawnRootComponent) return false;
+
+	UCharacterMovementComponent* CharacterMovement = Character->GetCharacterMovement();
+
+	Location = FRepMovement::RebaseOntoZeroOrigin(PawnRootComponent->GetComponentLocation(), Character);
+	Yaw = PawnRootComponent->GetComponentRotation().Yaw;
+	ViewPitch = Character->GetBaseAimRotation().Pitch;
+	Velocity = CharacterMovement->Velocity;
+	MovementMode = CharacterMovement->PackNetworkMovementMode();
+	bProxyIsJumpForceApplied = Character->bProxyIsJumpForceApplied || (Character->JumpForceTimeRemaining > 0.0f);
+	bIsCrouched = Character->bIsCrouched;
+
+	const auto CMPCharacterMovement = Cast<UCMPCharacterMovementComponent>(CharacterMovement);
+	bIsJogging = CMPCharacterMovement && CMPCharacterMovement->GetCurrentGait() == EGaits::ECMS_Jog;
+
+	const auto CMPCharacter = Cast<ACMPCharacter>(Character);
+	bIsAiming = CMPCharacter && CMPCharacter->IsAiming();
+	Acceleration = CMPCharacter ? CMPCharacter->GetPackedAcceleration() : FCMPReplicatedAcceleration();
+	Quantization = CMPCharacter ? CMPCharacter->GetMovementQuantization() : ECMPLocationQuantization::TwoDecimals;
+
+	// Timestamp is sent as zero if unused
+	bHasTimeStamp = (CharacterMovement->NetworkSmoothingMode == ENetworkSmoothingMode::Linear) || CharacterMovement->bNetworkAlwaysReplicateTransformUpdateTimestamp;
+	TimeStampMs = bHasTimeStamp ? uint16(FMath::RoundToInt64(CharacterMovement->GetServerLastTransformUpdateTimeStamp() * 1000.0) & 0xFFFF) : 0;
+
+	return true;
+}
+
+bool FCMPCharacterRepMovement::Equals(const FCMPCharacterRepMovement& Other) const
 {
-	if (RepMovement.Location != Other.RepMovement.Location)
+	if (Location != Other.Location)
+	{
+		return false;
+	}
+
+	if (Yaw != Other.Yaw || ViewPitch != Other.ViewPitch)
 	{
 		return false;
 	}
 
-	if (RepMovement.Rotation != Other.RepMovement.Rotation)
+	if (Velocity != Other.Velocity)
 	{
 		return false;
 	}
 
-	if (RepMovement.LinearVelocity != Other.RepMovement.LinearVelocity)
+	if (Acceleration != Other.Acceleration)
 	{
 		return false;
 	}
 
-	if (RepMovementMode != Other.RepMovementMode)
+	if (MovementMode != Other.MovementMode)
 	{
 		return false;
 	}
@@ -77,36 +163,249 @@ bool FSharedRepMovement::Equals(const FSharedRepMovement& Other, ACharacter* Cha
 		return false;
 	}
 
+	if (bIsJogging != Other.bIsJogging)
+	{
+		return false;
+	}
+
+	if (bIsAiming != Other.bIsAiming)
+	{
+		return false;
+	}
+
 	return true;
 }
 
-bool FSharedRepMovement::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+bool FCMPCharacterRepMovement::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	// The property is serialized once per connection, so each one gets the precision of its own viewer distance
+	ECMPLocationQuantization ConnectionQuantization = Quantization;
+	if (Ar.IsSaving())
+	{
+		const UPackageMapClient* PackageMapClient = Cast<UPackageMapClient>(Map);
+		const UNetConnection* Connection = PackageMapClient ? PackageMapClient->GetConnection() : nullptr;
+		const UCMPReplicationGraph* ReplicationGraph = Connection && Connection->Driver
+			                                               ? Cast<UCMPReplicationGraph>(Connection->Driver->GetReplicationDriver())
+			                                               : nullptr;
+		if (ReplicationGraph)
+		{
+			ReplicationGraph->GetMovementQuantizationForConnection(Location, Connection, ConnectionQuantization);
+		}
+	}
+	TGuardValue<ECMPLocationQuantization> QuantizationGuard(Quantization, ConnectionQuantization);
+
+	SerializeQuantization(Ar);
+	SerializeLocation(Ar);
+	SerializeState(Ar);
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+double FCMPCharacterRepMovement::GetLocationScale(ECMPLocationQuantization InQuantization)
 {
-	bOutSuccess = true;
-	RepMovement.NetSerialize(Ar, Map, bOutSuccess);
-	Ar << RepMovementMode;
-	Ar << bProxyIsJumpForceApplied;
-	Ar << bIsCrouched;
+	switch (InQuantization)
+	{
+	case ECMPLocationQuantization::WholeNumber:
+		return 1.0;
+	case ECMPLocationQuantization::Decimetre:
+		return 0.1;
+	default:
+		return 100.0;
+	}
+}
+
+double FCMPCharacterRepMovement::GetVelocityScale(ECMPLocationQuantization InQuantization)
+{
+	return InQuantization == ECMPLocationQuantization::Decimetre ? 0.1 : 1.0;
+}
+
+void FCMPCharacterRepMovement::SerializeQuantization(FArchive& Ar)
+{
+	uint8 Value = uint8(Quantization);
+	Ar.SerializeBits(&Value, 2);
+	Quantization = Value < uint8(ECMPLocationQuantization::MAX)
+		               ? ECMPLocationQuantization(Value)
+		               : ECMPLocationQuantization::TwoDecimals;
+}
+
+void FCMPCharacterRepMovement::SerializeLocation(FArchive& Ar)
+{
+	const double Scale = GetLocationScale(Quantization);
+
+	FIntVector Units = ToQuantizedUnits(Location, Scale);
+	SerializeSignedPacked(Ar, Units);
+
+	if (Ar.IsLoading())
+	{
+		Location = FVector(Units) / Scale;
+	}
+}
+
+void FCMPCharacterRepMovement::SerializeState(FArchive& Ar)
+{
+	// Flags: crouch, jump force, jog, timestamp, walking ground mode, aim
+	// PackNetworkMovementMode puts the mode in the low bits and the ground mode above them
+	const uint32 GroundShift = FMath::CeilLogTwo(uint32(MOVE_MAX));
+	const uint8 ModeMask = (1 << GroundShift) - 1;
+	const uint8 DefaultGroundMode = uint8(MOVE_Walking) << GroundShift;
+	uint8 Flags = 0;
+	if (Ar.IsSaving())
+	{
+		Flags = (bIsCrouched ? 0x01 : 0) | (bProxyIsJumpForceApplied ? 0x02 : 0) | (bIsJogging ? 0x04 : 0) |
+			(bHasTimeStamp ? 0x08 : 0) | ((MovementMode & ~ModeMask) == DefaultGroundMode ? 0x10 : 0) | (bIsAiming ? 0x20 : 0);
+	}
+	Ar.SerializeBits(&Flags, 6);
+
+	bIsCrouched = (Flags & 0x01) != 0;
+	bProxyIsJumpForceApplied = (Flags & 0x02) != 0;
+	bIsJogging = (Flags & 0x04) != 0;
+	bHasTimeStamp = (Flags & 0x08) != 0;
+	bIsAiming = (Flags & 0x20) != 0;
+
+	// Movement mode, only the mode bits when the ground mode is walking
+	if (Flags & 0x10)
+	{
+		uint8 Mode = MovementMode & ModeMask;
+		Ar.SerializeBits(&Mode, GroundShift);
+		MovementMode = DefaultGroundMode | (Mode & ModeMask);
+	}
+	else
+	{
+		Ar << MovementMode;
+	}
+
+	// Yaw and view pitch
+	uint16 CompressedYaw = FRotator::CompressAxisToShort(Yaw);
+	uint16 CompressedPitch = FRotator::CompressAxisToShort(ViewPitch);
+	Ar << CompressedYaw;
+	Ar << CompressedPitch;
+	Yaw = FRotator::DecompressAxisFromShort(CompressedYaw);
+	ViewPitch = FRotator::NormalizeAxis(FRotator::DecompressAxisFromShort(CompressedPitch));
+
+	// Velocity: XY as speed plus direction, Z only when non-zero
+	const double VelocityScale = GetVelocityScale(Quantization);
+	const int32 DirectionBits = Quantization == ECMPLocationQuantization::Decimetre ? CoarseVelocityDirectionBits : VelocityDirectionBits;
+	const int32 DirectionSteps = 1 << DirectionBits;
+
+	uint32 XYSpeed = FMath::RoundToInt(Velocity.Size2D() * VelocityScale);
+	Ar.SerializeIntPacked(XYSpeed);
 
-	// Timestamp, if non-zero.
-	uint8 bHasTimeStamp = (RepTimeStamp != 0.f);
-	Ar.SerializeBits(&bHasTimeStamp, 1);
+	uint16 XYDirection = 0;
+	if (XYSpeed > 0)
+	{
+		if (Ar.IsSaving())
+		{
+			double Radians = FMath::Atan2(Velocity.Y, Velocity.X);
+			if (Radians < 0.0) Radians += TWO_PI;
+			XYDirection = FMath::RoundToInt(Radians / TWO_PI * DirectionSteps) % DirectionSteps;
+		}
+		Ar.SerializeBits(&XYDirection, DirectionBits);
+	}
+
+	int16 Z = FMath::Clamp(FMath::RoundToInt(Velocity.Z * VelocityScale), int32(MIN_int16), int32(MAX_int16));
+	uint8 bHasZ = Z != 0;
+	Ar.SerializeBits(&bHasZ, 1);
+	if (bHasZ)
+	{
+		Ar << Z;
+	}
+
+	if (Ar.IsLoading())
+	{
+		FMath::PolarToCartesian(double(XYSpeed) / VelocityScale, double(XYDirection) * TWO_PI / DirectionSteps, Velocity.X, Velocity.Y);
+		Velocity.Z = bHasZ ? double(Z) / VelocityScale : 0.0;
+	}
+
+	// Acceleration, a standing or coasting character has none
+	uint8 bHasAcceleration = Acceleration != FCMPReplicatedAcceleration();
+	Ar.SerializeBits(&bHasAcceleration, 1);
+	if (bHasAcceleration)
+	{
+		Ar << Acceleration.AccelXYRadians;
+		Ar << Acceleration.AccelXYMagnitude;
+		Ar << Acceleration.AccelZ;
+	}
+	else if (Ar.IsLoading())
+	{
+		Acceleration = FCMPReplicatedAcceleration();
+	}
+
+	// Timestamp
 	if (bHasTimeStamp)
 	{
-		Ar << RepTimeStamp;
+		Ar << TimeStampMs;
 	}
 	else
 	{
-		RepTimeStamp = 0.f;
+		TimeStampMs = 0;
 	}
+}
+
+bool FSharedRepMovement::FillForCharacter(ACharacter* Character)
+{
+	return Movement.FillForCharacter(Character);
+}
+
+bool FSharedRepMovement::Equals(const FSharedRepMovement& Other, ACharacter* Character) const
+{
+	return Movement.Equals(Other.Movement);
+}
+
+bool FSharedRepMovement::EncodeDelta(const FSharedRepMovement& Keyframe, uint8 InKeyframeId)
+{
+	if (Movement.Quantization != Keyframe.Movement.Quantization) return false;
+
+	// Quantize both sides the way a full send would, so the client rebuilds exactly the keyframe precision
+	const double Scale = FCMPCharacterRepMovement::GetLocationScale(Movement.Quantization);
+	DeltaLocation = ToQuantizedUnits(Movement.Location, Scale) - ToQuantizedUnits(Keyframe.Movement.Location, Scale);
+	if (!IsDeltaInRange(DeltaLocation)) return false;
+
+	KeyframeId = InKeyframeId;
+	bIsKeyframe = false;
+	return true;
+}
+
+bool FSharedRepMovement::ApplyDelta(const FSharedRepMovement& Keyframe)
+{
+	if (bIsKeyframe) return true;
+	if (!Keyframe.bIsKeyframe || Keyframe.KeyframeId != KeyframeId) return false;
+
+	if (Keyframe.Movement.Quantization != Movement.Quantization) return false;
+
+	const double Scale = FCMPCharacterRepMovement::GetLocationScale(Movement.Quantization);
+	Movement.Location = FVector(ToQuantizedUnits(Keyframe.Movement.Location, Scale) + DeltaLocation) / Scale;
 
 	return true;
 }
 
+bool FSharedRepMovement::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint8 bKeyframe = bIsKeyframe;
+	Ar.SerializeBits(&bKeyframe, 1);
+	bIsKeyframe = bKeyframe;
+	Ar << KeyframeId;
+
+	Movement.SerializeQuantization(Ar);
+	if (bIsKeyframe)
+	{
+		Movement.SerializeLocation(Ar);
+	}
+	else
+	{
+		SerializeSignedPacked(Ar, DeltaLocation);
+	}
+
+	Movement.SerializeState(Ar);
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
 ACMPCharacter::ACMPCharacter(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer.SetDefaultSubobjectClass<UCMPCharacterMovementComponent>(CharacterMovementComponentName))
 {
-	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bCanEverTick = false;
 	bReplicates = true;
 
 	GetCharacterMovement()->SetIsReplicated(true);
@@ -117,6 +416,8 @@ ACMPCharacter::ACMPCharacter(const FObjectInitializer& ObjectInitializer)
 	FPCamera = CreateDefaultSubobject<UCameraComponent>("FPCamera");
 	FPCamera->SetupAttachment(GetMesh(), "CameraSocket");
 	FPCamera->bUsePawnControlRotation = true;
+
+	WeaponFireComponent = CreateDefaultSubobject<UCMPWeaponFireComponent>("WeaponFire");
 }
 
 void ACMPCharacter::BeginPlay()
@@ -135,43 +436,262 @@ void ACMPCharacter::BeginPlay()
 	if (HasAuthority())
 	{
 		SpawnGunsInventory();
+
+		if (const auto LagCompensation = UCMPLagCompensationSubsystem::Get(GetWorld()))
+		{
+			LagCompensation->RegisterCharacter(this);
+			bRegisteredForLagCompensation = true;
+		}
+	}
+
+	// Only proxies are throttled, autonomous and authority characters always run at full rate
+	if (GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		if (const auto SignificanceManager = UCMPSignificanceManager::Get(GetWorld()))
+		{
+			SignificanceManager->RegisterCharacter(this);
+			bRegisteredForSignificance = true;
+		}
 	}
 }
 
+void ACMPCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (bRegisteredForSignificance)
+	{
+		if (const auto SignificanceManager = UCMPSignificanceManager::Get(GetWorld()))
+		{
+			SignificanceManager->UnregisterCharacter(this);
+		}
+		bRegisteredForSignificance = false;
+	}
+
+	if (bRegisteredForLagCompensation)
+	{
+		// Looked up without the cvar, it may have been turned off since
+		if (const auto LagCompensation = GetWorld()->GetSubsystem<UCMPLagCompensationSubsystem>())
+		{
+			LagCompensation->UnregisterCharacter(this);
+		}
+		bRegisteredForLagCompensation = false;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void ACMPCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
 	DOREPLIFETIME(ACMPCharacter, CurrentWeapon);
-	DOREPLIFETIME(ACMPCharacter, HandTransform);
-	DOREPLIFETIME(ACMPCharacter, bInterpolateSight);
-	DOREPLIFETIME_CONDITION(ThisClass, ReplicatedAcceleration, COND_SimulatedOnly);
+	DOREPLIFETIME(ACMPCharacter, WeaponViewState);
+	DOREPLIFETIME(ACMPCharacter, bIsPooled);
+	DOREPLIFETIME(ACMPCharacter, PoolGeneration);
+	DOREPLIFETIME_CONDITION(ThisClass, CMPReplicatedMovement, COND_SimulatedOnly);
 }
 
 void ACMPCharacter::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
 {
 	Super::PreReplication(ChangedPropertyTracker);
 
-	if (CMPCharacterMovementComponent)
+	// Simulated proxies get movement, acceleration, timestamp, movement mode, crouch, jump force and view pitch from CMPReplicatedMovement
+	if (IsReplicatingMovement())
 	{
-		// Compress Acceleration: XY components as direction + magnitude, Z component as direct value
-		const double MaxAccel = CMPCharacterMovementComponent->MaxAcceleration;
-		const FVector CurrentAccel = CMPCharacterMovementComponent->GetCurrentAcceleration();
-		double AccelXYRadians, AccelXYMagnitude;
-		FMath::CartesianToPolar(CurrentAccel.X, CurrentAccel.Y, AccelXYMagnitude, AccelXYRadians);
+		CMPReplicatedMovement.FillForCharacter(this);
+	}
+
+	DOREPLIFETIME_ACTIVE_OVERRIDE_PRIVATE_PROPERTY(AActor, ReplicatedMovement, false);
+	DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(ACharacter, ReplicatedServerLastTransformUpdateTimeStamp, false);
+	DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(ACharacter, ReplicatedMovementMode, false);
+	DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(ACharacter, bIsCrouched, false);
+	DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(ACharacter, bProxyIsJumpForceApplied, false);
+	DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(APawn, RemoteViewPitch, false);
+}
+
+void ACMPCharacter::SetSignificanceTier(ECMPSignificanceTier InTier)
+{
+	// Possession can change after registration, a controlled character is never throttled
+	if (IsLocallyControlled() || GetLocalRole() != ROLE_SimulatedProxy)
+	{
+		InTier = ECMPSignificanceTier::Full;
+	}
+
+	SignificanceTier = InTier;
+	ApplySignificanceTickInterval(this, UCMPSignificanceManager::GetTickInterval(InTier));
+}
+
+void ACMPCharacter::ApplySignificanceTickInterval(AActor* Actor, float TickInterval) const
+{
+	Actor->SetActorTickInterval(TickInterval);
+
+	// Movement, mesh animation and anything else ticking on the actor
+	for (UActorComponent* Component : Actor->GetComponents())
+	{
+		if (Component && Component->PrimaryComponentTick.bCanEverTick)
+		{
+			Component->SetComponentTickInterval(TickInterval);
+		}
+	}
+
+	// Guns and their parts are attached actors
+	TArray<AActor*> AttachedActors;
+	Actor->GetAttachedActors(AttachedActors);
+	for (AActor* AttachedActor : AttachedActors)
+	{
+		ApplySignificanceTickInterval(AttachedActor, TickInterval);
+	}
+}
+
+void ACMPCharacter::MarkNetActive()
+{
+	LastNetActivityTime = GetWorld()->GetTimeSeconds();
+
+	if (bIsNetIdle)
+	{
+		bIsNetIdle = false;
+		ForceNetUpdate();
+	}
+}
+
+void ACMPCharacter::UpdateMovementActivity()
+{
+	const FRotator ViewRotation = GetBaseAimRotation();
+
+	// Compared against the rotation at the last activity, so slow turning still adds up
+	if (!GetVelocity().IsNearlyZero() || !CMPCharacterMovementComponent->GetCurrentAcceleration().IsNearlyZero() ||
+		!ViewRotation.Equals(LastActivityViewRotation, 0.5f))
+	{
+		LastActivityViewRotation = ViewRotation;
+		MarkNetActive();
+	}
+}
+
+void ACMPCharacter::ReleaseToPool()
+{
+	if (!HasAuthority() || bIsPooled) return;
+
+	if (bIsAiming) SetIsAiming(false);
+	CMPCharacterMovementComponent->StopMovementImmediately();
+	CMPCharacterMovementComponent->DisableMovement();
+
+	bIsPooled = true;
+	OnRep_IsPooled();
 
-		ReplicatedAcceleration.AccelXYRadians = FMath::FloorToInt((AccelXYRadians / TWO_PI) * 255.0);
-		// [0, 2PI] -> [0, 255]
-		ReplicatedAcceleration.AccelXYMagnitude = FMath::FloorToInt((AccelXYMagnitude / MaxAccel) * 255.0);
-		// [0, MaxAccel] -> [0, 255]
-		ReplicatedAcceleration.AccelZ = FMath::FloorToInt((CurrentAccel.Z / MaxAccel) * 127.0);
-		// [-MaxAccel, MaxAccel] -> [-127, 127]
+	// Dormancy only starts after the pooled state above has replicated
+	TArray<AActor*> PooledActors;
+	GetPooledActors(PooledActors);
+	for (AActor* Actor : PooledActors)
+	{
+		Actor->SetNetDormancy(DORM_DormantAll);
+	}
+}
+
+void ACMPCharacter::AcquireFromPool(const FTransform& SpawnTransform)
+{
+	if (!HasAuthority() || !bIsPooled) return;
+
+	TArray<AActor*> PooledActors;
+	GetPooledActors(PooledActors);
+	for (AActor* Actor : PooledActors)
+	{
+		Actor->SetNetDormancy(DORM_Awake);
+	}
+
+	SetActorLocationAndRotation(SpawnTransform.GetLocation(), SpawnTransform.GetRotation(), false, nullptr,
+	                            ETeleportType::ResetPhysics);
+	CMPCharacterMovementComponent->SetDefaultMovementMode();
+
+	ResetLoadout();
+	PoolGeneration++;
+
+	bIsPooled = false;
+	OnRep_IsPooled();
+	MarkNetActive();
+}
+
+void ACMPCharacter::OnRep_IsPooled()
+{
+	TArray<AActor*> PooledActors;
+	GetPooledActors(PooledActors);
+	for (AActor* Actor : PooledActors)
+	{
+		Actor->SetActorHiddenInGame(bIsPooled);
+		Actor->SetActorEnableCollision(!bIsPooled);
 	}
+
+	CMPCharacterMovementComponent->SetComponentTickEnabled(!bIsPooled);
+
+	// Nothing received before going in or out of the pool is a baseline for what follows
+	bHasReceivedSharedKeyframe = false;
 }
 
-void ACMPCharacter::Tick(float DeltaTime)
+void ACMPCharacter::OnRep_PoolGeneration()
 {
-	Super::Tick(DeltaTime);
+	// ResetLoadout usually hands out the same CurrentWeapon again, which never replicates as a change
+	LastWeapon = nullptr;
+	if (CurrentWeapon)
+	{
+		OnRep_CurrentWeapon();
+	}
+
+	bHasReceivedSharedKeyframe = false;
+}
+
+void ACMPCharacter::GetPooledActors(TArray<AActor*>& OutActors)
+{
+	OutActors.Add(this);
+
+	// Guns hang off the mesh and parts off the guns, so walk the attachment tree
+	for (int32 Index = 0; Index < OutActors.Num(); Index++)
+	{
+		TArray<AActor*> AttachedActors;
+		OutActors[Index]->GetAttachedActors(AttachedActors);
+		OutActors.Append(AttachedActors);
+	}
+}
+
+void ACMPCharacter::ResetLoadout()
+{
+	for (const auto Gun : GunsInventory)
+	{
+		Gun->ResetForReuse();
+
+		const FAttachmentTransformRules AttachRules(
+			EAttachmentRule::SnapToTarget, EAttachmentRule::SnapToTarget, EAttachmentRule::KeepRelative, true);
+		Gun->AttachToComponent(GetMesh(), AttachRules, GunHolsterSocketName);
+	}
+
+	WeaponFireComponent->ResetFiring();
+
+	// Equipped again from the holster like a freshly spawned inventory
+	LastWeapon = nullptr;
+	if (GunsInventory.Num() > 0)
+	{
+		CurrentWeapon = *GunsInventory.GetData();
+		OnRep_CurrentWeapon();
+	}
+}
+
+void ACMPCharacter::SetAimingFromMove(bool bWantsToAim)
+{
+	if (!HasAuthority() || bIsAiming == bWantsToAim) return;
+
+	SetIsAiming(bWantsToAim);
+	MarkNetActive();
+}
+
+bool ACMPCharacter::UpdateNetIdle(double IdleDelay)
+{
+	if (IdleDelay <= 0.0)
+	{
+		bIsNetIdle = false;
+	}
+	else if (!bIsNetIdle)
+	{
+		bIsNetIdle = GetWorld()->GetTimeSeconds() - LastNetActivityTime >= IdleDelay;
+	}
+
+	return bIsNetIdle;
 }
 
 void ACMPCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent)
@@ -200,6 +720,10 @@ void ACMPCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputCompon
 
 		EnhancedInputComponent->BindAction(CrouchAction, ETriggerEvent::Started, this,
 		                                   &ACMPCharacter::CrouchPressed);
+
+		EnhancedInputComponent->BindAction(FireAction, ETriggerEvent::Started, this, &ACMPCharacter::FireStarted);
+		EnhancedInputComponent->BindAction(FireAction, ETriggerEvent::Canceled, this, &ACMPCharacter::FireFinished);
+		EnhancedInputComponent->BindAction(FireAction, ETriggerEvent::Completed, this, &ACMPCharacter::FireFinished);
 	}
 }
 
@@ -213,6 +737,19 @@ void ACMPCharacter::OnMovementModeChanged(EMovementMode PrevMovementMode, uint8
 	ExitAiming();
 }
 
+FRotator ACMPCharacter::GetBaseAimRotation() const
+{
+	FRotator AimRotation = Super::GetBaseAimRotation();
+
+	// Simulated proxies get view pitch at 16 bits with their movement, RemoteViewPitch only has 8
+	if (GetLocalRole() == ROLE_SimulatedProxy && FMath::IsNearlyZero(GetActorRotation().Pitch))
+	{
+		AimRotation.Pitch = ReplicatedViewPitch;
+	}
+
+	return AimRotation;
+}
+
 void ACMPCharacter::Move(const FInputActionValue& Value)
 {
 	if (!Controller) return;
@@ -297,6 +834,18 @@ void ACMPCharacter::CrouchPressed(const FInputActionValue& Value)
 	CMPCharacterMovementComponent->ToggleCrouch();
 }
 
+void ACMPCharacter::FireStarted(const FInputActionValue& Value)
+{
+	if (!CurrentWeapon) return;
+
+	WeaponFireComponent->StartFire();
+}
+
+void ACMPCharacter::FireFinished(const FInputActionValue& Value)
+{
+	WeaponFireComponent->StopFire();
+}
+
 void ACMPCharacter::JumpPressed(const FInputActionValue& Value)
 {
 	if (CMPCharacterMovementComponent->IsCrouching())
@@ -313,16 +862,16 @@ void ACMPCharacter::JumpReleased(const FInputActionValue& Value)
 	ACharacter::StopJumping();
 }
 
-void ACMPCharacter::SetHandTransform(const FTransform& NewTransform)
+void ACMPCharacter::SetWeaponViewState(const FCMPWeaponViewState& NewViewState)
 {
-	HandTransform = NewTransform;
+	WeaponViewState = NewViewState;
 
-	if (HasAuthority()) OnRep_HandTransform();
+	if (HasAuthority()) OnRep_WeaponViewState();
 }
 
-void ACMPCharacter::SetInterpolateSight(const bool NewInterpolateSight)
+void ACMPCharacter::RefreshWeaponViewState()
 {
-	bInterpolateSight = NewInterpolateSight;
+	OnRep_WeaponViewState();
 }
 
 void ACMPCharacter::SetIsAiming(bool InIsAiming)
@@ -337,28 +886,47 @@ void ACMPCharacter::SetIsAiming(bool InIsAiming)
 		AnimInstance->bIsAiming = bIsAiming;
 	}
 
+	// Jog and aim intent only exist on the owning client, the server gets them from the saved moves
+	if (!IsLocallyControlled()) return;
+
+	CMPCharacterMovementComponent->SetWantsToAim(bIsAiming);
+
 	if (bIsAiming)
 	{
 		CMPCharacterMovementComponent->StopJog();
 	}
-	else if (!bIsWalkPressed)
-	{
-		// CMPCharacterMovementComponent->StopWalk();
-	}
 }
 
 void ACMPCharacter::OnRep_CurrentWeapon()
 {
+	// The new weapon may have been attached since the tier was last applied
+	if (bRegisteredForSignificance)
+	{
+		SetSignificanceTier(SignificanceTier);
+	}
+
+	// Aim state that arrived before the weapon
+	if (GetLocalRole() == ROLE_SimulatedProxy && bIsAiming != CMPReplicatedMovement.bIsAiming)
+	{
+		SetIsAiming(CMPReplicatedMovement.bIsAiming);
+	}
+
 	const auto AnimInstance = GetAnimInstance();
 	if (!AnimInstance) return;
 
 	AnimInstance->SwitchWeapon();
 }
 
-void ACMPCharacter::OnRep_HandTransform()
+void ACMPCharacter::OnRep_WeaponViewState()
 {
-	if (UKismetMathLibrary::EqualEqual_TransformTransform(HandTransform, FTransform()))
+	if (!CurrentWeapon) return;
+
+	CurrentWeapon->ApplyViewState(WeaponViewState);
+
+	bInterpolateSight = WeaponViewState.bInterpolateSight;
+	if (!CurrentWeapon->CalculateHandTransform(HandTransform))
 	{
+		HandTransform = FTransform();
 		ExitAiming();
 		return;
 	}
@@ -380,37 +948,12 @@ void ACMPCharacter::EnterAiming()
 		AnimInstance->IsPlayingSlotAnimation(AnimInstance->EquipSequence, AnimInstance->EquipAnimSlotName))
 		return;
 
-	ServerEnterAiming();
+	// The server picks the aim bit up from the next saved move
 	SetIsAiming(true);
 }
 
 void ACMPCharacter::ExitAiming()
 {
-	ServerExitAiming();
-	SetIsAiming(false);
-}
-
-void ACMPCharacter::ServerEnterAiming_Implementation()
-{
-	MulticastEnterAiming();
-}
-
-void ACMPCharacter::MulticastEnterAiming_Implementation()
-{
-	if (IsLocallyControlled()) return;
-
-	SetIsAiming(true);
-}
-
-void ACMPCharacter::ServerExitAiming_Implementation()
-{
-	MulticastExitAiming();
-}
-
-void ACMPCharacter::MulticastExitAiming_Implementation()
-{
-	if (IsLocallyControlled()) return;
-
 	SetIsAiming(false);
 }
 
@@ -489,7 +1032,13 @@ void ACMPCharacter::EquipCurrentWeapon()
 		const FAttachmentTransformRules AttachRules(
 			EAttachmentRule::SnapToTarget, EAttachmentRule::SnapToTarget, EAttachmentRule::KeepRelative, true);
 		CurrentWeapon->AttachToComponent(GetMesh(), AttachRules, GunSocketName);
-		CurrentWeapon->CalculateHandTransforms();
+		SetWeaponViewState(CurrentWeapon->MakeViewState());
+		MarkNetActive();
+	}
+	else
+	{
+		// The view state of the new gun may match the last one and never call its OnRep
+		OnRep_WeaponViewState();
 	}
 
 	UpdateWeaponAnims();
@@ -527,23 +1076,106 @@ FTransform ACMPCharacter::GetRightHandTransform(ERelativeTransformSpace Transfor
 	return GetMesh()->GetSocketTransform(RightHandSocketName, TransformSpace);
 }
 
-void ACMPCharacter::OnRep_ReplicatedAcceleration()
+FTransform ACMPCharacter::GetEquippedGunTransform() const
 {
-	if (!CMPCharacterMovementComponent) return;
+	return GetMesh()->GetSocketTransform(GunSocketName, RTS_World);
+}
 
-	// Decompress Acceleration
-	const double MaxAccel = CMPCharacterMovementComponent->MaxAcceleration;
-	const double AccelXYMagnitude = double(ReplicatedAcceleration.AccelXYMagnitude) * MaxAccel / 255.0;
-	// [0, 255] -> [0, MaxAccel]
-	const double AccelXYRadians = double(ReplicatedAcceleration.AccelXYRadians) * TWO_PI / 255.0;
-	// [0, 255] -> [0, 2PI]
+void ACMPCharacter::OnRep_CMPReplicatedMovement()
+{
+	ApplyReplicatedMovement(CMPReplicatedMovement);
+}
 
-	FVector UnpackedAcceleration(FVector::ZeroVector);
-	FMath::PolarToCartesian(AccelXYMagnitude, AccelXYRadians, UnpackedAcceleration.X, UnpackedAcceleration.Y);
-	UnpackedAcceleration.Z = double(ReplicatedAcceleration.AccelZ) * MaxAccel / 127.0;
-	// [-127, 127] -> [-MaxAccel, MaxAccel]
+void ACMPCharacter::ApplyReplicatedMovement(const FCMPCharacterRepMovement& Movement)
+{
+	// Timestamp
+	ReplicatedServerLastTransformUpdateTimeStamp = Movement.bHasTimeStamp ? UnwrapServerTimeStamp(Movement.TimeStampMs) : 0.f;
 
-	CMPCharacterMovementComponent->SetReplicatedAcceleration(UnpackedAcceleration);
+	// Acceleration, before the movement update so it is part of the same snapshot
+	if (CMPCharacterMovementComponent)
+	{
+		CMPCharacterMovementComponent->SetReplicatedAcceleration(
+			Movement.Acceleration.Unpack(CMPCharacterMovementComponent->GetAccelerationQuantizationRange()));
+	}
+
+	// Movement mode
+	if (ReplicatedMovementMode != Movement.MovementMode)
+	{
+		ReplicatedMovementMode = Movement.MovementMode;
+		GetCharacterMovement()->bNetworkMovementModeChanged = true;
+		GetCharacterMovement()->bNetworkUpdateReceived = true;
+	}
+
+	// Location, Rotation, Velocity, etc.
+	FRepMovement& MutableRepMovement = GetReplicatedMovement_Mutable();
+	MutableRepMovement.Location = Movement.Location;
+	MutableRepMovement.Rotation = FRotator(0.f, Movement.Yaw, 0.f);
+	MutableRepMovement.LinearVelocity = Movement.Velocity;
+
+	// This also sets LastRepMovement
+	OnRep_ReplicatedMovement();
+
+	// View pitch
+	ReplicatedViewPitch = Movement.ViewPitch;
+	SetRemoteViewPitch(Movement.ViewPitch);
+
+	// Jump force
+	bProxyIsJumpForceApplied = Movement.bProxyIsJumpForceApplied;
+
+	// Crouch
+	if (bIsCrouched != Movement.bIsCrouched)
+	{
+		bIsCrouched = Movement.bIsCrouched;
+		OnRep_IsCrouched();
+	}
+
+	// Gait
+	if (bIsJogging != Movement.bIsJogging && CMPCharacterMovementComponent)
+	{
+		bIsJogging = Movement.bIsJogging;
+		CMPCharacterMovementComponent->SetReplicatedGait(bIsJogging ? EGaits::ECMS_Jog : EGaits::ECMS_Walk);
+	}
+
+	// Aim
+	if (bIsAiming != Movement.bIsAiming)
+	{
+		SetIsAiming(Movement.bIsAiming);
+	}
+}
+
+float ACMPCharacter::UnwrapServerTimeStamp(uint16 TimeStampMs)
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+	if (UnwrappedServerTimeStampMs == INDEX_NONE)
+	{
+		// Start one wrap in, so late updates can go backwards without reaching zero
+		UnwrappedServerTimeStampMs = 0x10000 + TimeStampMs;
+	}
+	else
+	{
+		// Idle, pooled or irrelevant characters can be silent for more than the 32 s a 16 bit delta covers, so unwrap
+		// around where the server clock should be by now rather than around the previous timestamp
+		const int64 ExpectedMs = UnwrappedServerTimeStampMs + FMath::RoundToInt64((Now - LastTimeStampReceiveTime) * 1000.0);
+		UnwrappedServerTimeStampMs = FMath::Max<int64>(ExpectedMs + int16(uint16(TimeStampMs - uint16(ExpectedMs))), 1);
+	}
+	LastTimeStampReceiveTime = Now;
+
+	return float(double(UnwrappedServerTimeStampMs) / 1000.0);
+}
+
+const FCMPReplicatedAcceleration& ACMPCharacter::GetPackedAcceleration()
+{
+	if (CMPCharacterMovementComponent)
+	{
+		const FVector CurrentAccel = CMPCharacterMovementComponent->GetCurrentAcceleration();
+		if (CurrentAccel != LastPackedAcceleration)
+		{
+			LastPackedAcceleration = CurrentAccel;
+			PackedAcceleration.Pack(CurrentAccel, CMPCharacterMovementComponent->GetAccelerationQuantizationRange());
+		}
+	}
+
+	return PackedAcceleration;
 }
 
 bool ACMPCharacter::UpdateSharedReplication()
@@ -560,7 +1192,22 @@ bool ACMPCharacter::UpdateSharedReplication()
 			if (!SharedMovement.Equals(LastSharedReplication, this))
 			{
 				LastSharedReplication = SharedMovement;
-				ReplicatedMovementMode = SharedMovement.RepMovementMode;
+				ReplicatedMovementMode = SharedMovement.Movement.MovementMode;
+
+				// Clients that missed the keyframe drop the deltas until the next one, regular property replication still carries the full state
+				const bool bKeyframeDue = SharedSendsSinceKeyframe == INDEX_NONE ||
+					SharedSendsSinceKeyframe >= CryMP::RepGraph::FastSharedKeyframeInterval;
+				if (bKeyframeDue || !SharedMovement.EncodeDelta(SharedKeyframe, SharedKeyframeId))
+				{
+					SharedMovement.bIsKeyframe = true;
+					SharedMovement.KeyframeId = ++SharedKeyframeId;
+					SharedKeyframe = SharedMovement;
+					SharedSendsSinceKeyframe = 0;
+				}
+				else
+				{
+					++SharedSendsSinceKeyframe;
+				}
 
 				FastSharedReplication(SharedMovement);
 			}
@@ -582,32 +1229,26 @@ void ACMPCharacter::FastSharedReplication_Implementation(const FSharedRepMovemen
 	// Timestamp is checked to reject old moves.
 	if (GetLocalRole() == ROLE_SimulatedProxy)
 	{
-		// Timestamp
-		ReplicatedServerLastTransformUpdateTimeStamp = SharedRepMovement.RepTimeStamp;
-
-		// Movement mode
-		if (ReplicatedMovementMode != SharedRepMovement.RepMovementMode)
+		// Out of FastShared range for a while, a delta could now carry the id of our keyframe against a newer one
+		const double Now = GetWorld()->GetTimeSeconds();
+		if (Now - LastSharedReceiveTime > CryMP::RepGraph::MaxSharedKeyframeAge)
 		{
-			ReplicatedMovementMode = SharedRepMovement.RepMovementMode;
-			GetCharacterMovement()->bNetworkMovementModeChanged = true;
-			GetCharacterMovement()->bNetworkUpdateReceived = true;
+			bHasReceivedSharedKeyframe = false;
 		}
+		LastSharedReceiveTime = Now;
 
-		// Location, Rotation, Velocity, etc.
-		FRepMovement& MutableRepMovement = GetReplicatedMovement_Mutable();
-		MutableRepMovement = SharedRepMovement.RepMovement;
-
-		// This also sets LastRepMovement
-		OnRep_ReplicatedMovement();
-
-		// Jump force
-		bProxyIsJumpForceApplied = SharedRepMovement.bProxyIsJumpForceApplied;
-
-		// Crouch
-		if (bIsCrouched != SharedRepMovement.bIsCrouched)
+		// Keyframe or delta against the last keyframe we got, without it we wait for the next keyframe
+		FSharedRepMovement ResolvedMovement = SharedRepMovement;
+		if (ResolvedMovement.bIsKeyframe)
 		{
-			bIsCrouched = SharedRepMovement.bIsCrouched;
-			OnRep_IsCrouched();
+			ReceivedSharedKeyframe = ResolvedMovement;
+			bHasReceivedSharedKeyframe = true;
 		}
+		else if (!bHasReceivedSharedKeyframe || !ResolvedMovement.ApplyDelta(ReceivedSharedKeyframe))
+		{
+			return;
+		}
+
+		ApplyReplicatedMovement(ResolvedMovement.Movement);
 	}
 }
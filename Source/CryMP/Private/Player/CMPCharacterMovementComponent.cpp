@@ -4,24 +4,113 @@
 #include "Player/CMPCharacterMovementComponent.h"
 
 #include "KismetAnimationLibrary.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/NetDriver.h"
 #include "GameFramework/Character.h"
+#include "Misc/ScopeExit.h"
 #include "Net/UnrealNetwork.h"
+#include "Player/CMPCharacter.h"
+#include "System/CMPMovementValidationSubsystem.h"
 
 
+namespace CryMP::Movement
+{
+	int32 EnableSnapshotInterpolation = 1;
+	static FAutoConsoleVariableRef CVarCryMPMovementEnableSnapshotInterpolation(TEXT("CryMP.Movement.EnableSnapshotInterpolation"), EnableSnapshotInterpolation, TEXT("Allow simulated proxies with bUseSnapshotInterpolation to use the snapshot buffer. 0 falls back to stock smoothing."), ECVF_Default);
+
+	int32 EnableAdaptiveMoveInterval = 1;
+	static FAutoConsoleVariableRef CVarCryMPMovementEnableAdaptiveMoveInterval(TEXT("CryMP.Movement.EnableAdaptiveMoveInterval"), EnableAdaptiveMoveInterval, TEXT("Let the server raise the minimum time between ServerMove calls of its clients when its frame budget runs out."), ECVF_Default);
+
+	// Server game thread time as a fraction of its tick budget where the interval starts to rise, and where it reaches MaxServerMoveInterval
+	float MoveIntervalLoadStart = 0.5f;
+	static FAutoConsoleVariableRef CVarCryMPMovementMoveIntervalLoadStart(TEXT("CryMP.Movement.MoveIntervalLoadStart"), MoveIntervalLoadStart, TEXT("Server game thread time as a fraction of the tick budget where the minimum ServerMove interval starts to rise."), ECVF_Default);
+
+	float MoveIntervalLoadFull = 0.9f;
+	static FAutoConsoleVariableRef CVarCryMPMovementMoveIntervalLoadFull(TEXT("CryMP.Movement.MoveIntervalLoadFull"), MoveIntervalLoadFull, TEXT("Server game thread time as a fraction of the tick budget where the minimum ServerMove interval reaches MaxServerMoveInterval."), ECVF_Default);
+
+	float MinServerMoveInterval = 1.f / 120.f;
+	static FAutoConsoleVariableRef CVarCryMPMovementMinServerMoveInterval(TEXT("CryMP.Movement.MinServerMoveInterval"), MinServerMoveInterval, TEXT("Minimum time between ServerMove calls while the server has budget to spare."), ECVF_Default);
+
+	float MaxServerMoveInterval = 1.f / 20.f;
+	static FAutoConsoleVariableRef CVarCryMPMovementMaxServerMoveInterval(TEXT("CryMP.Movement.MaxServerMoveInterval"), MaxServerMoveInterval, TEXT("Minimum time between ServerMove calls at full server load."), ECVF_Default);
+
+	float MoveIntervalUpdatePeriod = 1.f;
+	static FAutoConsoleVariableRef CVarCryMPMovementMoveIntervalUpdatePeriod(TEXT("CryMP.Movement.MoveIntervalUpdatePeriod"), MoveIntervalUpdatePeriod, TEXT("Seconds between updates of the interval sent to each client."), ECVF_Default);
+
+	int32 MaxServerFixedStepsPerFrame = 8;
+	static FAutoConsoleVariableRef CVarCryMPMovementMaxServerFixedStepsPerFrame(TEXT("CryMP.Movement.MaxServerFixedStepsPerFrame"), MaxServerFixedStepsPerFrame, TEXT("Fixed steps the server simulates for one remote client per frame, over all of its moves. Time beyond that is not simulated and the client is corrected."), ECVF_Default);
+
+	int32 EnableClientAuthoritativeMovement = 1;
+	static FAutoConsoleVariableRef CVarCryMPMovementEnableClientAuthoritativeMovement(TEXT("CryMP.Movement.EnableClientAuthoritativeMovement"), EnableClientAuthoritativeMovement, TEXT("Allow characters with bUseClientAuthoritativeMovement to accept validated client positions on the server. 0 simulates every move."), ECVF_Default);
+
+	float ClientAuthSpeedTolerance = 1.1f;
+	static FAutoConsoleVariableRef CVarCryMPMovementClientAuthSpeedTolerance(TEXT("CryMP.Movement.ClientAuthSpeedTolerance"), ClientAuthSpeedTolerance, TEXT("Multiplier on the gait max speed a client authoritative move may reach."), ECVF_Default);
+
+	float ClientAuthAccelerationTolerance = 1.5f;
+	static FAutoConsoleVariableRef CVarCryMPMovementClientAuthAccelerationTolerance(TEXT("CryMP.Movement.ClientAuthAccelerationTolerance"), ClientAuthAccelerationTolerance, TEXT("Multiplier on the gait max acceleration a client authoritative move may gain speed at."), ECVF_Default);
+
+	int32 ClientAuthSweepInterval = 4;
+	static FAutoConsoleVariableRef CVarCryMPMovementClientAuthSweepInterval(TEXT("CryMP.Movement.ClientAuthSweepInterval"), ClientAuthSweepInterval, TEXT("Sweep the client path for collision every this many accepted moves."), ECVF_Default);
+
+	int32 ClientAuthRevokeMoves = 60;
+	static FAutoConsoleVariableRef CVarCryMPMovementClientAuthRevokeMoves(TEXT("CryMP.Movement.ClientAuthRevokeMoves"), ClientAuthRevokeMoves, TEXT("Moves simulated by the server after a client authoritative move failed validation."), ECVF_Default);
+}
+
+namespace
+{
+	// Game thread time of recent frames against the server tick budget
+	uint64 ServerLoadFrame = 0;
+	float SmoothedServerLoad = 0.f;
+
+	/** Adds the last frame to the server load, every server character calls it each tick and the first one per frame counts. */
+	void SampleServerLoad(const UWorld* World)
+	{
+		if (ServerLoadFrame == GFrameCounter) return;
+		ServerLoadFrame = GFrameCounter;
+
+		const UNetDriver* NetDriver = World->GetNetDriver();
+		const float BudgetMs = 1000.f / FMath::Max(NetDriver ? NetDriver->GetNetServerMaxTickRate() : 30, 1);
+		const float Load = FPlatformTime::ToMilliseconds(GGameThreadTime) / BudgetMs;
+		SmoothedServerLoad = FMath::Lerp(SmoothedServerLoad, Load, 0.05f);
+	}
+}
+
 #pragma region Saved Move
 UCMPCharacterMovementComponent::FSavedMove_CMP::FSavedMove_CMP()
 {
 	Saved_bWantsToJog = 0;
+	Saved_bWantsToAim = 0;
 }
 
 bool UCMPCharacterMovementComponent::FSavedMove_CMP::CanCombineWith(const FSavedMovePtr& NewMove,
                                                                     ACharacter* InCharacter, float MaxDelta) const
 {
 	const FSavedMove_CMP* NewCMPMove = static_cast<FSavedMove_CMP*>(NewMove.Get());
+	const auto CharacterMovement = Cast<UCMPCharacterMovementComponent>(InCharacter->GetCharacterMovement());
 
-	if (NewCMPMove->Saved_bWantsToJog != Saved_bWantsToJog) return false;
+	ECMPCombineResult Result = ECMPCombineResult::Rejected;
 
-	return Super::CanCombineWith(NewMove, InCharacter, MaxDelta);
+	// Every fixed step is its own move, a combined move would be simulated with a different delta on the server
+	if (CharacterMovement && CharacterMovement->IsUsingFixedTickSimulation())
+	{
+		Result = ECMPCombineResult::Rejected;
+	}
+	else if (NewCMPMove->Saved_bWantsToJog != Saved_bWantsToJog)
+	{
+		Result = ECMPCombineResult::RejectedGait;
+	}
+	else if (NewCMPMove->Saved_bWantsToAim == Saved_bWantsToAim && Super::CanCombineWith(NewMove, InCharacter, MaxDelta))
+	{
+		Result = ECMPCombineResult::Combined;
+	}
+
+	if (CharacterMovement)
+	{
+		CharacterMovement->Telemetry.AddCombineResult(Result);
+	}
+
+	return Result == ECMPCombineResult::Combined;
 }
 
 void UCMPCharacterMovementComponent::FSavedMove_CMP::Clear()
@@ -29,6 +118,7 @@ void UCMPCharacterMovementComponent::FSavedMove_CMP::Clear()
 	Super::Clear();
 
 	Saved_bWantsToJog = 0;
+	Saved_bWantsToAim = 0;
 }
 
 uint8 UCMPCharacterMovementComponent::FSavedMove_CMP::GetCompressedFlags() const
@@ -36,6 +126,7 @@ uint8 UCMPCharacterMovementComponent::FSavedMove_CMP::GetCompressedFlags() const
 	uint8 Result = Super::GetCompressedFlags();
 
 	if (Saved_bWantsToJog) Result |= FLAG_Custom_0;
+	if (Saved_bWantsToAim) Result |= FLAG_Custom_1;
 
 	return Result;
 }
@@ -49,6 +140,7 @@ void UCMPCharacterMovementComponent::FSavedMove_CMP::SetMoveFor(ACharacter* C, f
 	const auto CharacterMovement = Cast<UCMPCharacterMovementComponent>(C->GetCharacterMovement());
 
 	Saved_bWantsToJog = CharacterMovement->Safe_bWantsToJog;
+	Saved_bWantsToAim = CharacterMovement->Safe_bWantsToAim;
 }
 
 void UCMPCharacterMovementComponent::FSavedMove_CMP::PrepMoveFor(ACharacter* C)
@@ -57,6 +149,7 @@ void UCMPCharacterMovementComponent::FSavedMove_CMP::PrepMoveFor(ACharacter* C)
 
 	const auto CharacterMovement = Cast<UCMPCharacterMovementComponent>(C->GetCharacterMovement());
 	CharacterMovement->Safe_bWantsToJog = Saved_bWantsToJog;
+	CharacterMovement->Safe_bWantsToAim = Saved_bWantsToAim;
 }
 #pragma endregion
 
@@ -76,10 +169,24 @@ FSavedMovePtr UCMPCharacterMovementComponent::FNetworkPredictionData_Client_CMP:
 UCMPCharacterMovementComponent::UCMPCharacterMovementComponent()
 {
 	NavAgentProps.bCanCrouch = true;
+
+	Safe_bWantsToJog = false;
+	Safe_bWantsToAim = false;
+
+	SetNetworkMoveDataContainer(CMPNetworkMoveDataContainer);
 }
 
 void UCMPCharacterMovementComponent::SimulateMovement(float DeltaTime)
 {
+	if (CanUseSnapshotInterpolation())
+	{
+		if (SimulateFromSnapshots(DeltaTime)) return;
+	}
+	else if (!SnapshotBuffer.IsEmpty())
+	{
+		SnapshotBuffer.Reset();
+	}
+
 	if (bHasReplicatedAcceleration)
 	{
 		// Preserve our replicated acceleration
@@ -97,6 +204,15 @@ void UCMPCharacterMovementComponent::InitializeComponent()
 {
 	Super::InitializeComponent();
 
+	// Snapshots are ordered by the server move timestamp, make sure it is always sent
+	if (bUseSnapshotInterpolation)
+	{
+		bNetworkAlwaysReplicateTransformUpdateTimestamp = true;
+	}
+
+	AccelerationQuantizationRange = FMath::Max3(MaxAcceleration, WalkSettings.MaxAcceleration,
+	                                            JogSettings.MaxAcceleration);
+
 	CurrentGait = EGaits::ECMS_Walk;
 	UseGaitSettings(WalkSettings);
 }
@@ -117,11 +233,136 @@ FNetworkPredictionData_Client* UCMPCharacterMovementComponent::GetPredictionData
 	return ClientPredictionData;
 }
 
-void UCMPCharacterMovementComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+void UCMPCharacterMovementComponent::SmoothCorrection(const FVector& OldLocation, const FQuat& OldRotation,
+                                                      const FVector& NewLocation, const FQuat& NewRotation)
 {
-	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+	if (!CanUseSnapshotInterpolation() || CharacterOwner->GetReplicatedServerLastTransformUpdateTimeStamp() <= 0.f)
+	{
+		SnapshotBuffer.Reset();
+		Super::SmoothCorrection(OldLocation, OldRotation, NewLocation, NewRotation);
+		return;
+	}
+
+	FCMPMovementSnapshot Snapshot;
+	Snapshot.ServerTime = CharacterOwner->GetReplicatedServerLastTransformUpdateTimeStamp();
+	Snapshot.Location = NewLocation;
+	Snapshot.Rotation = NewRotation;
+	Snapshot.Velocity = Velocity;
+	Snapshot.Acceleration = bHasReplicatedAcceleration ? Acceleration : FVector::ZeroVector;
+
+	const bool bWasEmpty = SnapshotBuffer.IsEmpty();
+	SnapshotBuffer.AddSnapshot(Snapshot, GetWorld()->GetTimeSeconds(), SnapshotInterpolationSettings);
+
+	// Otherwise the actor stays where playback put it and SimulateMovement moves it along the buffer
+	if (bWasEmpty)
+	{
+		UpdatedComponent->SetWorldLocationAndRotation(NewLocation, NewRotation, false, nullptr, ETeleportType::TeleportPhysics);
+	}
 
-	DOREPLIFETIME_CONDITION(UCMPCharacterMovementComponent, Safe_bWantsToJog, COND_SkipOwner);
+	bJustTeleported = bWasEmpty;
+	bNetworkSmoothingComplete = true;
+}
+
+bool UCMPCharacterMovementComponent::ServerCheckClientError(float ClientTimeStamp, float DeltaTime,
+                                                            const FVector& Accel, const FVector& ClientWorldLocation,
+                                                            const FVector& RelativeClientLocation,
+                                                            UPrimitiveComponent* ClientMovementBase,
+                                                            FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	const bool bNeedsCorrection = Super::ServerCheckClientError(ClientTimeStamp, DeltaTime, Accel, ClientWorldLocation,
+	                                                            RelativeClientLocation, ClientMovementBase,
+	                                                            ClientBaseBoneName, ClientMovementMode);
+	if (bNeedsCorrection)
+	{
+		PendingCorrectionMagnitude = FVector::Dist(UpdatedComponent->GetComponentLocation(), ClientWorldLocation);
+	}
+
+	return bNeedsCorrection;
+}
+
+void UCMPCharacterMovementComponent::SendClientAdjustment()
+{
+	// Acks of good moves go through here as well, only count real corrections
+	const FNetworkPredictionData_Server_Character* ServerData = HasPredictionData_Server() ? GetPredictionData_Server_Character() : nullptr;
+	if (ServerData && ServerData->PendingAdjustment.TimeStamp > 0.f && !ServerData->PendingAdjustment.bAckGoodMove)
+	{
+		Telemetry.AddCorrectionSent(PendingCorrectionMagnitude);
+		PendingCorrectionMagnitude = 0.f;
+	}
+
+	Super::SendClientAdjustment();
+}
+
+bool UCMPCharacterMovementComponent::ClientUpdatePositionAfterServerUpdate()
+{
+	// Saved moves left after the adjustment are the ones replayed on top of it
+	const FNetworkPredictionData_Client_Character* ClientData = HasPredictionData_Client() ? GetPredictionData_Client_Character() : nullptr;
+	const int32 ReplayedMoves = ClientData && ClientData->bUpdatePosition ? ClientData->SavedMoves.Num() : INDEX_NONE;
+
+	const bool bResult = Super::ClientUpdatePositionAfterServerUpdate();
+
+	if (ReplayedMoves != INDEX_NONE)
+	{
+		Telemetry.AddCorrectionReceived(ReplayedMoves);
+	}
+
+	return bResult;
+}
+
+float UCMPCharacterMovementComponent::GetSnapshotDelay() const
+{
+	return CanUseSnapshotInterpolation() && !SnapshotBuffer.IsEmpty()
+		       ? float(SnapshotBuffer.GetDelay(SnapshotInterpolationSettings))
+		       : 0.f;
+}
+
+bool UCMPCharacterMovementComponent::CanUseSnapshotInterpolation() const
+{
+	if (!bUseSnapshotInterpolation || !CryMP::Movement::EnableSnapshotInterpolation) return false;
+	if (!CharacterOwner || !UpdatedComponent || CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy) return false;
+
+	// Root motion and based movement have their own proxy handling
+	if (CharacterOwner->IsReplayingRootMotion() || CharacterOwner->IsPlayingNetworkedRootMotionMontage()) return false;
+	if (CharacterOwner->GetReplicatedBasedMovement().HasRelativeLocation()) return false;
+
+	return true;
+}
+
+bool UCMPCharacterMovementComponent::SimulateFromSnapshots(float DeltaTime)
+{
+	FCMPMovementSnapshot State;
+	if (!SnapshotBuffer.Sample(GetWorld()->GetTimeSeconds(), SnapshotInterpolationSettings, State)) return false;
+
+	if (bNetworkMovementModeChanged)
+	{
+		ApplyNetworkMovementMode(CharacterOwner->GetReplicatedMovementMode());
+		bNetworkMovementModeChanged = false;
+	}
+
+	UpdatedComponent->SetWorldLocationAndRotation(State.Location, State.Rotation, false, nullptr, ETeleportType::None);
+	Velocity = State.Velocity;
+	if (!bHasReplicatedAcceleration)
+	{
+		Acceleration = State.Acceleration;
+	}
+
+	bNetworkUpdateReceived = false;
+	bJustTeleported = false;
+	UpdateComponentVelocity();
+
+	LastUpdateLocation = UpdatedComponent->GetComponentLocation();
+	LastUpdateRotation = UpdatedComponent->GetComponentQuat();
+	LastUpdateVelocity = Velocity;
+
+	return true;
+}
+
+FVector UCMPCharacterMovementComponent::RoundAcceleration(FVector InAccel) const
+{
+	// Simulate with the value FCMPCharacterNetworkMoveData sends, so the server replays exactly what the client predicted.
+	FCMPPackedAcceleration Packed;
+	Packed.Pack(InAccel, AccelerationQuantizationRange);
+	return Packed.Unpack(AccelerationQuantizationRange);
 }
 
 void UCMPCharacterMovementComponent::UpdateFromCompressedFlags(uint8 Flags)
@@ -129,55 +370,453 @@ void UCMPCharacterMovementComponent::UpdateFromCompressedFlags(uint8 Flags)
 	Super::UpdateFromCompressedFlags(Flags);
 
 	Safe_bWantsToJog = (Flags & FSavedMove_Character::FLAG_Custom_0) != 0;
+	Safe_bWantsToAim = (Flags & FSavedMove_Character::FLAG_Custom_1) != 0;
+}
+
+void UCMPCharacterMovementComponent::PerformMovement(float DeltaTime)
+{
+#if !UE_BUILD_SHIPPING
+	if (FCMPMovementTimings* Timings = FCMPMovementTimings::Active)
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		Super::PerformMovement(DeltaTime);
+		Timings->PerformMovementCycles += FPlatformTime::Cycles64() - StartCycles;
+		Timings->PerformMovementCalls++;
+		return;
+	}
+#endif
+
+	Super::PerformMovement(DeltaTime);
 }
 
 void UCMPCharacterMovementComponent::OnMovementUpdated(float DeltaSeconds, const FVector& OldLocation,
                                                        const FVector& OldVelocity)
 {
+#if !UE_BUILD_SHIPPING
+	const uint64 StartCycles = FCMPMovementTimings::Active ? FPlatformTime::Cycles64() : 0;
+	ON_SCOPE_EXIT
+	{
+		if (FCMPMovementTimings* Timings = FCMPMovementTimings::Active)
+		{
+			Timings->MovementUpdatedCycles += FPlatformTime::Cycles64() - StartCycles;
+			Timings->MovementUpdatedCalls++;
+		}
+	};
+#endif
+
 	Super::OnMovementUpdated(DeltaSeconds, OldLocation, OldVelocity);
 
-	if (MovementMode == MOVE_Walking)
+	// Proxies never see jog or aim intent, their gait comes from SetReplicatedGait
+	if (CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy) return;
+
+	UpdateGait();
+
+	if (CharacterOwner && CharacterOwner->HasAuthority())
+	{
+		UpdateAimFromMove();
+		UpdateNetActivity();
+	}
+}
+
+void UCMPCharacterMovementComponent::UpdateAimFromMove() const
+{
+	if (CharacterOwner->IsLocallyControlled()) return;
+
+	if (ACMPCharacter* CMPCharacter = Cast<ACMPCharacter>(CharacterOwner))
+	{
+		CMPCharacter->SetAimingFromMove(Safe_bWantsToAim);
+	}
+}
+
+void UCMPCharacterMovementComponent::UpdateNetActivity() const
+{
+	if (ACMPCharacter* CMPCharacter = Cast<ACMPCharacter>(CharacterOwner))
+	{
+		CMPCharacter->UpdateMovementActivity();
+	}
+}
+
+void UCMPCharacterMovementComponent::UpdateGait()
+{
+	if (MovementMode != MOVE_Walking) return;
+
+	const auto MoveAngle = UKismetAnimationLibrary::CalculateDirection(Velocity, GetPawnOwner()->GetActorRotation());
+	const auto AbsMoveAngle = FMath::Abs(MoveAngle);
+
+	SetGait(Safe_bWantsToJog && !Safe_bWantsToAim && AbsMoveAngle <= Jog_Angle ? EGaits::ECMS_Jog : EGaits::ECMS_Walk);
+}
+
+void UCMPCharacterMovementComponent::TickComponent(float DeltaTime, ELevelTick TickType,
+                                                   FActorComponentTickFunction* ThisTickFunction)
+{
+	if (IsUsingFixedTickSimulation())
+	{
+		TickFixed(DeltaTime, TickType, ThisTickFunction);
+		return;
+	}
+
+	if (bHasFixedTickPresentation)
+	{
+		ResetFixedTickPresentation();
+	}
+
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_Authority && !CharacterOwner->IsLocallyControlled())
+	{
+		SampleServerLoad(GetWorld());
+		UpdateServerMoveInterval();
+	}
+}
+
+void UCMPCharacterMovementComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(ThisClass, ServerMoveIntervalMs, COND_OwnerOnly);
+}
+
+float UCMPCharacterMovementComponent::GetClientNetSendDeltaTime(const APlayerController* PC,
+                                                               const FNetworkPredictionData_Client_Character* ClientData,
+                                                               const FSavedMovePtr& NewMove) const
+{
+	// Moves made in between are combined where possible, the rest go out together with the next send
+	const float NetSendDeltaTime = Super::GetClientNetSendDeltaTime(PC, ClientData, NewMove);
+	return FMath::Max(NetSendDeltaTime, ServerMoveIntervalMs * 0.001f);
+}
+
+void UCMPCharacterMovementComponent::UpdateServerMoveInterval()
+{
+	const float WorldTime = GetWorld()->GetTimeSeconds();
+	if (WorldTime < NextServerMoveIntervalUpdateTime) return;
+	NextServerMoveIntervalUpdateTime = WorldTime + CryMP::Movement::MoveIntervalUpdatePeriod;
+
+	float Interval = 0.f;
+	if (CryMP::Movement::EnableAdaptiveMoveInterval)
 	{
-		const auto MoveAngle =
-			UKismetAnimationLibrary::CalculateDirection(Velocity, GetPawnOwner()->GetActorRotation());
-		const auto AbsMoveAngle = FMath::Abs(MoveAngle);
+		const float Alpha = FMath::SmoothStep(CryMP::Movement::MoveIntervalLoadStart, CryMP::Movement::MoveIntervalLoadFull,
+		                                      SmoothedServerLoad);
+		Interval = FMath::Lerp(CryMP::Movement::MinServerMoveInterval, CryMP::Movement::MaxServerMoveInterval, Alpha);
+	}
 
-		if (Safe_bWantsToJog && AbsMoveAngle <= Jog_Angle)
+	const uint8 IntervalMs = static_cast<uint8>(FMath::Clamp(FMath::RoundToInt(Interval * 1000.f), 0, 255));
+	if (IntervalMs != ServerMoveIntervalMs)
+	{
+		ServerMoveIntervalMs = IntervalMs;
+	}
+}
+
+FVector UCMPCharacterMovementComponent::ConsumeInputVector()
+{
+	return bIsFixedStepping ? FixedTickInputVector : Super::ConsumeInputVector();
+}
+
+void UCMPCharacterMovementComponent::MoveAutonomous(float ClientTimeStamp, float DeltaTime, uint8 CompressedFlags,
+                                                    const FVector& NewAccel)
+{
+	// Runs on the server and for client replays, both snap the same way
+	int32 FixedSteps = 0;
+	if (bUseFixedTickSimulation)
+	{
+		FixedSteps = FMath::Clamp(FMath::RoundToInt(DeltaTime / GetFixedTimeStep()), 1, MaxFixedStepsPerFrame);
+		DeltaTime = FixedSteps * GetFixedTimeStep();
+	}
+
+	if (!HasValidData()) return;
+
+	const FVector OldLocation = UpdatedComponent->GetComponentLocation();
+	const float OldMaxSpeed = GetMaxSpeed();
+
+	// Client authoritative moves only cover time once their window closes with a new move
+	float MovedTime = DeltaTime;
+	if (CanAcceptClientAuthoritativeMove())
+	{
+		MovedTime = MoveClientAuthoritative(ClientTimeStamp, DeltaTime, CompressedFlags, NewAccel);
+	}
+	else
+	{
+		// A client sending many small moves still costs a bounded number of steps per frame, the time left over is
+		// not simulated and ServerMoveHandleClientError corrects the client
+		if (FixedSteps > 0 && CharacterOwner->GetLocalRole() == ROLE_Authority && !CharacterOwner->IsLocallyControlled())
 		{
-			if (CurrentGait != EGaits::ECMS_Jog)
-			{
-				CurrentGait = EGaits::ECMS_Jog;
-				UseGaitSettings(JogSettings);
-			}
+			FixedSteps = ConsumeServerFixedSteps(FixedSteps);
+			if (FixedSteps == 0) return;
+
+			DeltaTime = FixedSteps * GetFixedTimeStep();
+			MovedTime = DeltaTime;
 		}
-		else
+
+		Super::MoveAutonomous(ClientTimeStamp, DeltaTime, CompressedFlags, NewAccel);
+	}
+
+	AddMoveForValidation(OldLocation, OldMaxSpeed, MovedTime);
+}
+
+int32 UCMPCharacterMovementComponent::ConsumeServerFixedSteps(int32 Steps)
+{
+	if (ServerFixedStepsFrame != GFrameCounter)
+	{
+		ServerFixedStepsFrame = GFrameCounter;
+		ServerFixedStepsThisFrame = 0;
+	}
+
+	Steps = FMath::Min(Steps, FMath::Max(CryMP::Movement::MaxServerFixedStepsPerFrame - ServerFixedStepsThisFrame, 0));
+	ServerFixedStepsThisFrame += Steps;
+	return Steps;
+}
+
+void UCMPCharacterMovementComponent::AddMoveForValidation(const FVector& OldLocation, float OldMaxSpeed, float MovedTime)
+{
+	// Only moves of remote clients, replays and local controllers are not validated
+	if (MovedTime <= 0.f || !HasValidData() || !GetCurrentNetworkMoveData()) return;
+	if (CharacterOwner->GetLocalRole() != ROLE_Authority || CharacterOwner->IsLocallyControlled()) return;
+
+	const auto MovementValidation = GetWorld()->GetSubsystem<UCMPMovementValidationSubsystem>();
+	ACMPCharacter* CMPCharacter = Cast<ACMPCharacter>(CharacterOwner);
+	if (!MovementValidation || !CMPCharacter) return;
+
+	// A gait change or crouch lowers the limit during the move, and the character then brakes down to it over several
+	// moves instead of being clamped, so the limit only falls as fast as braking can slow the character
+	float BrakingRate = GetMaxBrakingDeceleration();
+	if (IsMovingOnGround())
+	{
+		BrakingRate += (bUseSeparateBrakingFriction ? BrakingFriction : GroundFriction) * BrakingFrictionFactor * GetMaxSpeed();
+	}
+	ValidationMaxSpeed = FMath::Max3(OldMaxSpeed, GetMaxSpeed(), ValidationMaxSpeed - BrakingRate * MovedTime);
+
+	MovementValidation->AddMove(CMPCharacter, UpdatedComponent->GetComponentLocation() - OldLocation, MovedTime,
+	                            ValidationMaxSpeed, *this);
+}
+
+bool UCMPCharacterMovementComponent::CanAcceptClientAuthoritativeMove()
+{
+	if (!bUseClientAuthoritativeMovement || !CryMP::Movement::EnableClientAuthoritativeMovement) return false;
+	if (!CharacterOwner || CharacterOwner->GetLocalRole() != ROLE_Authority || CharacterOwner->IsLocallyControlled()) return false;
+
+	// Only while handling a ServerMove, not for moves of a local or AI controller
+	const FCharacterNetworkMoveData* MoveData = GetCurrentNetworkMoveData();
+	if (!MoveData) return false;
+
+	if (ClientAuthorityRevokedMoves > 0)
+	{
+		if (MoveData->NetworkMoveType == FCharacterNetworkMoveData::ENetworkMoveType::NewMove)
 		{
-			if (CurrentGait != EGaits::ECMS_Walk)
-			{
-				CurrentGait = EGaits::ECMS_Walk;
-				UseGaitSettings(WalkSettings);
-			}
+			ClientAuthorityRevokedMoves--;
 		}
+		return false;
 	}
+
+	// Root motion and based movement stay server simulated
+	if (CharacterOwner->IsPlayingRootMotion() || MoveData->MovementBase != nullptr) return false;
+
+	TEnumAsByte<EMovementMode> ClientMovementMode;
+	TEnumAsByte<EMovementMode> ClientGroundMode;
+	uint8 ClientCustomMode;
+	UnpackNetworkMovementMode(MoveData->MovementMode, ClientMovementMode, ClientCustomMode, ClientGroundMode);
+	if (MoveData->NetworkMoveType == FCharacterNetworkMoveData::ENetworkMoveType::NewMove &&
+		ClientMovementMode != MOVE_Walking && ClientMovementMode != MOVE_Falling)
+	{
+		ClientAuthoritativeTime = 0.f;
+		return false;
+	}
+
+	return MovementMode == MOVE_Walking || MovementMode == MOVE_Falling;
 }
 
-void UCMPCharacterMovementComponent::TickComponent(float DeltaTime, ELevelTick TickType,
-                                                   FActorComponentTickFunction* ThisTickFunction)
+float UCMPCharacterMovementComponent::MoveClientAuthoritative(float ClientTimeStamp, float DeltaTime,
+                                                              uint8 CompressedFlags, const FVector& NewAccel)
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	UpdateFromCompressedFlags(CompressedFlags);
+	CharacterOwner->CheckJumpInput(DeltaTime);
+
+	Acceleration = ConstrainInputAcceleration(NewAccel).GetClampedToMaxSize(GetMaxAcceleration());
+	AnalogInputModifier = ComputeAnalogInputModifier();
 
+	// Only the new move of a ServerMove carries the client location, older moves just add their time to it
+	ClientAuthoritativeTime += DeltaTime;
+	ClientAuthoritativeMaxSpeed = FMath::Max(ClientAuthoritativeMaxSpeed, GetMaxSpeed());
+
+	const FCharacterNetworkMoveData* MoveData = GetCurrentNetworkMoveData();
+	if (MoveData->NetworkMoveType != FCharacterNetworkMoveData::ENetworkMoveType::NewMove) return 0.f;
+
+	const float Elapsed = ClientAuthoritativeTime;
+	const float MaxSpeed = ClientAuthoritativeMaxSpeed;
+	ClientAuthoritativeTime = 0.f;
+	ClientAuthoritativeMaxSpeed = 0.f;
+
+	if (!ValidateClientAuthoritativeMove(MoveData->Location, Elapsed, MaxSpeed))
+	{
+		// Simulate the whole window from the last accepted state, ServerMoveHandleClientError then corrects the client
+		ClientAuthorityRevokedMoves = CryMP::Movement::ClientAuthRevokeMoves;
+		ClientAuthoritativeSweepStart.Reset();
+		Super::MoveAutonomous(ClientTimeStamp, Elapsed, CompressedFlags, NewAccel);
+		return Elapsed;
+	}
+
+	UpdateCharacterStateBeforeMovement(Elapsed);
+
+	TEnumAsByte<EMovementMode> ClientMovementMode;
+	TEnumAsByte<EMovementMode> ClientGroundMode;
+	uint8 ClientCustomMode;
+	UnpackNetworkMovementMode(MoveData->MovementMode, ClientMovementMode, ClientCustomMode, ClientGroundMode);
+
+	Velocity = (MoveData->Location - UpdatedComponent->GetComponentLocation()) / Elapsed;
+	UpdatedComponent->SetWorldLocation(MoveData->Location, false, nullptr, ETeleportType::None);
+	SetMovementMode(ClientMovementMode);
+	if (IsMovingOnGround())
+	{
+		Velocity.Z = 0.f;
+	}
+	UpdateComponentVelocity();
+
+	UpdateGait();
+	UpdateAimFromMove();
+	UpdateNetActivity();
+	UpdateCharacterStateAfterMovement(Elapsed);
+	CharacterOwner->ClearJumpInput(Elapsed);
+
+	LastUpdateLocation = UpdatedComponent->GetComponentLocation();
+	LastUpdateRotation = UpdatedComponent->GetComponentQuat();
+	LastUpdateVelocity = Velocity;
+
+	return Elapsed;
+}
+
+bool UCMPCharacterMovementComponent::ValidateClientAuthoritativeMove(const FVector& ClientLocation, float Elapsed,
+                                                                     float MaxSpeed)
+{
+	if (Elapsed <= UE_SMALL_NUMBER) return false;
+
+	const FVector OldLocation = UpdatedComponent->GetComponentLocation();
+	const FVector Displacement = ClientLocation - OldLocation;
+	const FVector NewVelocity = Displacement / Elapsed;
+
+	// Speed against the fastest gait limit seen since the last accepted move, quantization gets a little slack
+	const double Speed2D = NewVelocity.Size2D();
+	if (Speed2D > MaxSpeed * CryMP::Movement::ClientAuthSpeedTolerance + 10.0) return false;
+
+	// Only speed gain is bounded, hitting a wall can stop a character instantly
+	const double SpeedGain = Speed2D - Velocity.Size2D();
+	if (SpeedGain > GetMaxAcceleration() * CryMP::Movement::ClientAuthAccelerationTolerance * Elapsed + 10.0) return false;
+
+	const double MaxRise = FMath::Max<double>(JumpZVelocity, MaxSpeed) * CryMP::Movement::ClientAuthSpeedTolerance * Elapsed
+		+ MaxStepHeight;
+	if (Displacement.Z > MaxRise) return false;
+
+	// Sweep the path since the last sweep every few moves, with the bottom raised by the step height so steps and
+	// slopes do not block it
+	if (!ClientAuthoritativeSweepStart.IsSet())
+	{
+		ClientAuthoritativeSweepStart = OldLocation;
+		ClientAuthoritativeMovesSinceSweep = 0;
+	}
+
+	if (++ClientAuthoritativeMovesSinceSweep < CryMP::Movement::ClientAuthSweepInterval) return true;
+
+	float Radius, HalfHeight;
+	CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleSize(Radius, HalfHeight);
+	const float StepOffset = FMath::Min(MaxStepHeight * 0.5f, HalfHeight - Radius);
+	const FCollisionShape Shape = FCollisionShape::MakeCapsule(FMath::Max(Radius - 2.f, 1.f), HalfHeight - StepOffset);
+	const FVector Lift(0.f, 0.f, StepOffset);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(CMPClientAuthoritativeSweep), false, CharacterOwner);
+	FCollisionResponseParams ResponseParams;
+	InitCollisionParams(QueryParams, ResponseParams);
+
+	FHitResult Hit;
+	const bool bBlocked = GetWorld()->SweepSingleByChannel(Hit, ClientAuthoritativeSweepStart.GetValue() + Lift,
+	                                                       ClientLocation + Lift, UpdatedComponent->GetComponentQuat(),
+	                                                       UpdatedComponent->GetCollisionObjectType(), Shape,
+	                                                       QueryParams, ResponseParams);
+
+	ClientAuthoritativeSweepStart = ClientLocation;
+	ClientAuthoritativeMovesSinceSweep = 0;
+
+	// A start inside geometry says nothing about the path
+	return !bBlocked || Hit.bStartPenetrating;
+}
+
+bool UCMPCharacterMovementComponent::IsUsingFixedTickSimulation() const
+{
+	return bUseFixedTickSimulation && CharacterOwner && UpdatedComponent && CharacterOwner->IsLocallyControlled();
+}
+
+void UCMPCharacterMovementComponent::TickFixed(float DeltaTime, ELevelTick TickType,
+                                               FActorComponentTickFunction* ThisTickFunction)
+{
+	const float Step = GetFixedTimeStep();
+	FixedTickAccumulator += DeltaTime;
+
+	int32 Steps = FMath::FloorToInt(FixedTickAccumulator / Step);
+	if (Steps > MaxFixedStepsPerFrame)
+	{
+		Steps = MaxFixedStepsPerFrame;
+		FixedTickAccumulator = Steps * Step;
+	}
+
+	if (Steps > 0)
+	{
+		// Input accumulated since the last step applies to all steps of this frame
+		FixedTickInputVector = Super::ConsumeInputVector();
+
+		bIsFixedStepping = true;
+		for (int32 Index = 0; Index < Steps; Index++)
+		{
+			FixedTickPreviousLocation = UpdatedComponent->GetComponentLocation();
+			Super::TickComponent(Step, TickType, ThisTickFunction);
+		}
+		bIsFixedStepping = false;
+
+		FixedTickAccumulator -= Steps * Step;
+
+		if (bJustTeleported || !bHasFixedTickPresentation)
+		{
+			FixedTickPreviousLocation = UpdatedComponent->GetComponentLocation();
+		}
+	}
+
+	UpdateFixedTickPresentation();
+}
+
+void UCMPCharacterMovementComponent::UpdateFixedTickPresentation()
+{
+	USkeletalMeshComponent* Mesh = CharacterOwner->GetMesh();
+	if (!Mesh) return;
+
+	// Draw the mesh where the character was the fraction of a step ago that has not been simulated yet
+	const float Alpha = FMath::Clamp(FixedTickAccumulator / GetFixedTimeStep(), 0.f, 1.f);
+	const FVector CurrentLocation = UpdatedComponent->GetComponentLocation();
+	const FVector Offset = (FixedTickPreviousLocation - CurrentLocation) * (1.f - Alpha);
+
+	Mesh->SetRelativeLocation(CharacterOwner->GetBaseTranslationOffset() +
+		UpdatedComponent->GetComponentQuat().UnrotateVector(Offset));
+	bHasFixedTickPresentation = true;
+}
+
+void UCMPCharacterMovementComponent::ResetFixedTickPresentation()
+{
+	if (USkeletalMeshComponent* Mesh = CharacterOwner ? CharacterOwner->GetMesh() : nullptr)
+	{
+		Mesh->SetRelativeLocation(CharacterOwner->GetBaseTranslationOffset());
+	}
+
+	FixedTickAccumulator = 0.f;
+	bHasFixedTickPresentation = false;
 }
 
 void UCMPCharacterMovementComponent::StartJog()
 {
 	Safe_bWantsToJog = true;
-	ServerSetWantToJog(true);
 }
 
 void UCMPCharacterMovementComponent::StopJog()
 {
 	Safe_bWantsToJog = false;
-	ServerSetWantToJog(false);
+}
+
+void UCMPCharacterMovementComponent::SetWantsToAim(bool bValue)
+{
+	Safe_bWantsToAim = bValue;
 }
 
 void UCMPCharacterMovementComponent::ToggleCrouch()
@@ -201,18 +840,16 @@ void UCMPCharacterMovementComponent::SetReplicatedAcceleration(const FVector& In
 	Acceleration = InAcceleration;
 }
 
-void UCMPCharacterMovementComponent::SetWantToJog(bool Value)
+void UCMPCharacterMovementComponent::SetReplicatedGait(EGaits InGait)
 {
-	if (!GetOwner()->HasAuthority())
-	{
-		ServerSetWantToJog(Value);
-	}
-
-	Safe_bWantsToJog = Value;
+	SetGait(InGait);
 }
 
-void UCMPCharacterMovementComponent::ServerSetWantToJog_Implementation(bool Value)
+void UCMPCharacterMovementComponent::SetGait(EGaits InGait)
 {
-	SetWantToJog(Value);
+	if (CurrentGait == InGait) return;
+
+	CurrentGait = InGait;
+	UseGaitSettings(CurrentGait == EGaits::ECMS_Jog ? JogSettings : WalkSettings);
 }
 #pragma endregion
@@ -0,0 +1,306 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Player/CMPCharacterNetworkMoveData.h"
+
+#include "GameFramework/CharacterMovementComponent.h"
+#include "Player/CMPCharacterMovementComponent.h"
+
+
+namespace
+{
+	// Flags driven by player input, each gets its own bit: jump, crouch, jog (Custom_0) and aim (Custom_1).
+	constexpr uint8 IntentFlagsMask =
+		FSavedMove_Character::FLAG_JumpPressed | FSavedMove_Character::FLAG_WantsToCrouch |
+		FSavedMove_Character::FLAG_Custom_0 | FSavedMove_Character::FLAG_Custom_1;
+
+	constexpr uint8 PackIntentFlags(uint8 Flags)
+	{
+		return (Flags & 0x03) | ((Flags & 0x30) >> 2);
+	}
+
+	constexpr uint8 UnpackIntentFlags(uint8 Bits)
+	{
+		return (Bits & 0x03) | ((Bits & 0x0C) << 2);
+	}
+
+	uint32 TimeStampToBits(float TimeStamp)
+	{
+		uint32 Bits;
+		FMemory::Memcpy(&Bits, &TimeStamp, sizeof(Bits));
+		return Bits;
+	}
+
+	float BitsToTimeStamp(uint32 Bits)
+	{
+		float TimeStamp;
+		FMemory::Memcpy(&TimeStamp, &Bits, sizeof(TimeStamp));
+		return TimeStamp;
+	}
+
+	// What PackNetworkMovementMode gives for walking with walking as the ground mode, the mode sits in the low bits and
+	// the ground mode above them
+	const uint8 PackedWalkingMode = MOVE_Walking | (MOVE_Walking << FMath::CeilLogTwo(uint32(MOVE_MAX)));
+
+	template <typename T>
+	void SerializeOptional(FArchive& Ar, T& Value, const T& DefaultValue)
+	{
+		uint8 bNotDefault = Ar.IsSaving() && Value != DefaultValue;
+		Ar.SerializeBits(&bNotDefault, 1);
+		if (bNotDefault)
+		{
+			Ar << Value;
+		}
+		else if (Ar.IsLoading())
+		{
+			Value = DefaultValue;
+		}
+	}
+}
+
+#pragma region Packed Acceleration
+void FCMPPackedAcceleration::Pack(const FVector& Acceleration, double Range)
+{
+	*this = FCMPPackedAcceleration();
+	if (Range <= 0.0) return;
+
+	constexpr int32 DirectionSteps = 1 << DirectionBits;
+	constexpr int32 MaxMagnitude = (1 << MagnitudeBits) - 1;
+
+	const double Magnitude = FMath::Min(Acceleration.Size2D(), Range);
+	XYMagnitude = FMath::RoundToInt(Magnitude / Range * MaxMagnitude);
+	if (XYMagnitude > 0)
+	{
+		double Radians = FMath::Atan2(Acceleration.Y, Acceleration.X);
+		if (Radians < 0.0) Radians += TWO_PI;
+
+		XYDirection = FMath::RoundToInt(Radians / TWO_PI * DirectionSteps) % DirectionSteps;
+	}
+
+	Z = FMath::RoundToInt(FMath::Clamp(Acceleration.Z / Range, -1.0, 1.0) * MAX_int16);
+}
+
+FVector FCMPPackedAcceleration::Unpack(double Range) const
+{
+	constexpr int32 DirectionSteps = 1 << DirectionBits;
+	constexpr int32 MaxMagnitude = (1 << MagnitudeBits) - 1;
+
+	FVector Result(FVector::ZeroVector);
+	if (Range <= 0.0) return Result;
+
+	const double Magnitude = double(XYMagnitude) * Range / MaxMagnitude;
+	const double Radians = double(XYDirection) * TWO_PI / DirectionSteps;
+	FMath::PolarToCartesian(Magnitude, Radians, Result.X, Result.Y);
+	Result.Z = double(Z) * Range / MAX_int16;
+
+	return Result;
+}
+
+void FCMPPackedAcceleration::NetSerialize(FArchive& Ar)
+{
+	uint8 bHasXY = XYMagnitude != 0;
+	Ar.SerializeBits(&bHasXY, 1);
+	if (bHasXY)
+	{
+		if (Ar.IsLoading())
+		{
+			XYDirection = 0;
+			XYMagnitude = 0;
+		}
+		Ar.SerializeBits(&XYDirection, DirectionBits);
+		Ar.SerializeBits(&XYMagnitude, MagnitudeBits);
+	}
+	else
+	{
+		XYDirection = 0;
+		XYMagnitude = 0;
+	}
+
+	uint8 bHasZ = Z != 0;
+	Ar.SerializeBits(&bHasZ, 1);
+	if (bHasZ)
+	{
+		Ar << Z;
+	}
+	else
+	{
+		Z = 0;
+	}
+}
+#pragma endregion
+
+#pragma region Network Move Data
+bool FCMPCharacterNetworkMoveData::Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar,
+                                             UPackageMap* PackageMap, ENetworkMoveType MoveType)
+{
+	NetworkMoveType = MoveType;
+
+	// The new move is serialized first, so it is a valid baseline for the pending and old moves on both ends.
+	const FCMPCharacterNetworkMoveData* Baseline = nullptr;
+	if (MoveType != ENetworkMoveType::NewMove)
+	{
+		Baseline = static_cast<const FCMPCharacterNetworkMoveData*>(
+			CharacterMovement.GetNetworkMoveDataContainer().GetNewMoveData());
+		if (Baseline == this) Baseline = nullptr;
+	}
+
+	const auto CMPMovement = Cast<UCMPCharacterMovementComponent>(&CharacterMovement);
+	const double AccelerationRange = CMPMovement ? CMPMovement->GetAccelerationQuantizationRange() : 0.0;
+
+	SerializeTimeStamp(Ar, Baseline);
+	SerializeAcceleration(Ar, AccelerationRange, Baseline);
+	SerializeControlRotation(Ar, Baseline);
+	SerializeMoveFlags(Ar, Baseline);
+
+	if (MoveType == ENetworkMoveType::NewMove)
+	{
+		// Location, movement base and ending movement mode are only used for error checking of the new move.
+		bool bLocalSuccess = true;
+		Location.NetSerialize(Ar, PackageMap, bLocalSuccess);
+
+		SerializeOptional<UPrimitiveComponent*>(Ar, MovementBase, nullptr);
+		SerializeOptional<FName>(Ar, MovementBaseBoneName, NAME_None);
+		SerializeOptional<uint8>(Ar, MovementMode, PackedWalkingMode);
+	}
+	else if (Ar.IsLoading() && Baseline)
+	{
+		Location = Baseline->Location;
+		MovementBase = Baseline->MovementBase;
+		MovementBaseBoneName = Baseline->MovementBaseBoneName;
+		MovementMode = Baseline->MovementMode;
+	}
+
+	return !Ar.IsError();
+}
+
+void FCMPCharacterNetworkMoveData::SerializeTimeStamp(FArchive& Ar, const FCMPCharacterNetworkMoveData* Baseline)
+{
+	if (!Baseline)
+	{
+		Ar << TimeStamp;
+		return;
+	}
+
+	// Older moves are a few ms apart: the difference of the raw float bits is small, packs into 1-3 bytes and restores the exact value.
+	const uint32 BaselineBits = TimeStampToBits(Baseline->TimeStamp);
+	uint32 Delta = BaselineBits - TimeStampToBits(TimeStamp);
+	Ar.SerializeIntPacked(Delta);
+
+	if (Ar.IsLoading())
+	{
+		TimeStamp = BitsToTimeStamp(BaselineBits - Delta);
+	}
+}
+
+void FCMPCharacterNetworkMoveData::SerializeAcceleration(FArchive& Ar, double Range,
+                                                         const FCMPCharacterNetworkMoveData* Baseline)
+{
+	FCMPPackedAcceleration Packed;
+	if (Ar.IsSaving())
+	{
+		Packed.Pack(Acceleration, Range);
+	}
+
+	uint8 bSameAsBaseline = 0;
+	if (Baseline)
+	{
+		FCMPPackedAcceleration BaselinePacked;
+		BaselinePacked.Pack(Baseline->Acceleration, Range);
+
+		bSameAsBaseline = Ar.IsSaving() && Packed == BaselinePacked;
+		Ar.SerializeBits(&bSameAsBaseline, 1);
+		if (bSameAsBaseline)
+		{
+			Packed = BaselinePacked;
+		}
+	}
+
+	if (!bSameAsBaseline)
+	{
+		Packed.NetSerialize(Ar);
+	}
+
+	if (Ar.IsLoading())
+	{
+		Acceleration = Packed.Unpack(Range);
+	}
+}
+
+void FCMPCharacterNetworkMoveData::SerializeControlRotation(FArchive& Ar, const FCMPCharacterNetworkMoveData* Baseline)
+{
+	uint16 Pitch = FRotator::CompressAxisToShort(ControlRotation.Pitch);
+	uint16 Yaw = FRotator::CompressAxisToShort(ControlRotation.Yaw);
+	uint16 Roll = FRotator::CompressAxisToShort(ControlRotation.Roll);
+
+	if (Baseline)
+	{
+		uint8 bSameAsBaseline = Ar.IsSaving() &&
+			Pitch == FRotator::CompressAxisToShort(Baseline->ControlRotation.Pitch) &&
+			Yaw == FRotator::CompressAxisToShort(Baseline->ControlRotation.Yaw) &&
+			Roll == FRotator::CompressAxisToShort(Baseline->ControlRotation.Roll);
+		Ar.SerializeBits(&bSameAsBaseline, 1);
+		if (bSameAsBaseline)
+		{
+			if (Ar.IsLoading())
+			{
+				ControlRotation = Baseline->ControlRotation;
+			}
+			return;
+		}
+	}
+
+	Ar << Pitch;
+	Ar << Yaw;
+
+	// Characters never roll the camera, so roll costs a single bit.
+	uint8 bHasRoll = Roll != 0;
+	Ar.SerializeBits(&bHasRoll, 1);
+	if (bHasRoll)
+	{
+		Ar << Roll;
+	}
+	else
+	{
+		Roll = 0;
+	}
+
+	if (Ar.IsLoading())
+	{
+		ControlRotation.Pitch = FRotator::DecompressAxisFromShort(Pitch);
+		ControlRotation.Yaw = FRotator::DecompressAxisFromShort(Yaw);
+		ControlRotation.Roll = FRotator::DecompressAxisFromShort(Roll);
+	}
+}
+
+void FCMPCharacterNetworkMoveData::SerializeMoveFlags(FArchive& Ar, const FCMPCharacterNetworkMoveData* Baseline)
+{
+	if (Baseline)
+	{
+		uint8 bSameAsBaseline = Ar.IsSaving() && CompressedMoveFlags == Baseline->CompressedMoveFlags;
+		Ar.SerializeBits(&bSameAsBaseline, 1);
+		if (bSameAsBaseline)
+		{
+			CompressedMoveFlags = Baseline->CompressedMoveFlags;
+			return;
+		}
+	}
+
+	uint8 IntentBits = PackIntentFlags(CompressedMoveFlags);
+	Ar.SerializeBits(&IntentBits, 4);
+
+	uint8 OtherFlags = CompressedMoveFlags & ~IntentFlagsMask;
+	SerializeOptional<uint8>(Ar, OtherFlags, 0);
+
+	if (Ar.IsLoading())
+	{
+		CompressedMoveFlags = UnpackIntentFlags(IntentBits & 0x0F) | (OtherFlags & ~IntentFlagsMask);
+	}
+}
+#pragma endregion
+
+FCMPCharacterNetworkMoveDataContainer::FCMPCharacterNetworkMoveDataContainer()
+{
+	NewMoveData = &CMPMoveData[0];
+	PendingMoveData = &CMPMoveData[1];
+	OldMoveData = &CMPMoveData[2];
+}
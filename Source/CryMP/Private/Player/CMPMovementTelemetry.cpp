@@ -0,0 +1,135 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Player/CMPMovementTelemetry.h"
+
+#include "EngineUtils.h"
+#include "Player/CMPCharacter.h"
+#include "Player/CMPCharacterMovementComponent.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+
+DEFINE_LOG_CATEGORY_STATIC(LogCryMPMovementTelemetry, Log, All);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Corrections Sent"), STAT_CryMPCorrectionsSent, STATGROUP_CryMPMovement);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Correction Magnitude"), STAT_CryMPCorrectionMagnitude, STATGROUP_CryMPMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Corrections Received"), STAT_CryMPCorrectionsReceived, STATGROUP_CryMPMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Moves Replayed"), STAT_CryMPMovesReplayed, STATGROUP_CryMPMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Moves Combined"), STAT_CryMPMovesCombined, STATGROUP_CryMPMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Combine Rejected"), STAT_CryMPCombineRejected, STATGROUP_CryMPMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Combine Rejected By Gait"), STAT_CryMPCombineRejectedByGait, STATGROUP_CryMPMovement);
+
+CSV_DEFINE_CATEGORY(CryMPMovement, true);
+
+#if !UE_BUILD_SHIPPING
+FCMPMovementTimings* FCMPMovementTimings::Active = nullptr;
+#endif
+
+namespace
+{
+	template <typename T, int32 NumLimits>
+	int32 GetBucket(const T (&Limits)[NumLimits], T Value)
+	{
+		for (int32 Index = 0; Index < NumLimits; Index++)
+		{
+			if (Value <= Limits[Index]) return Index;
+		}
+		return NumLimits;
+	}
+
+	template <typename T, int32 NumLimits>
+	FString HistogramToString(const T (&Limits)[NumLimits], const uint32 (&Counts)[NumLimits + 1])
+	{
+		FString Result;
+		for (int32 Index = 0; Index <= NumLimits; Index++)
+		{
+			const FString Label = Index < NumLimits
+				                      ? FString::Printf(TEXT("<=%s"), *LexToString(Limits[Index]))
+				                      : FString::Printf(TEXT(">%s"), *LexToString(Limits[NumLimits - 1]));
+			Result += FString::Printf(TEXT("%s%s:%u"), Index > 0 ? TEXT(" ") : TEXT(""), *Label, Counts[Index]);
+		}
+		return Result;
+	}
+
+	void DumpTelemetry(const TArray<FString>& Args, UWorld* World)
+	{
+		if (!World) return;
+
+		const bool bReset = Args.Contains(TEXT("reset"));
+		for (TActorIterator<ACMPCharacter> It(World); It; ++It)
+		{
+			const auto Movement = Cast<UCMPCharacterMovementComponent>(It->GetCharacterMovement());
+			if (!Movement) continue;
+
+			UE_LOG(LogCryMPMovementTelemetry, Display, TEXT("%s (%s): %s"), *It->GetName(),
+			       *UEnum::GetValueAsString(It->GetLocalRole()), *Movement->GetTelemetry().ToString());
+
+			if (bReset)
+			{
+				Movement->ResetTelemetry();
+			}
+		}
+	}
+
+	FAutoConsoleCommandWithWorldAndArgs DumpTelemetryCommand(
+		TEXT("CryMP.Movement.DumpTelemetry"),
+		TEXT("Logs correction and move combining counters of every CMP character. Pass reset to clear them afterwards."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&DumpTelemetry));
+}
+
+void FCMPMovementTelemetry::AddCorrectionSent(float Magnitude)
+{
+	CorrectionsSent++;
+	CorrectionMagnitudeHistogram[GetBucket(CorrectionBucketLimits, Magnitude)]++;
+	MaxCorrectionMagnitude = FMath::Max(MaxCorrectionMagnitude, Magnitude);
+
+	INC_DWORD_STAT(STAT_CryMPCorrectionsSent);
+	INC_FLOAT_STAT_BY(STAT_CryMPCorrectionMagnitude, Magnitude);
+	CSV_CUSTOM_STAT(CryMPMovement, CorrectionsSent, 1, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(CryMPMovement, CorrectionMagnitude, Magnitude, ECsvCustomStatOp::Max);
+}
+
+void FCMPMovementTelemetry::AddCorrectionReceived(int32 ReplayedMoves)
+{
+	CorrectionsReceived++;
+	MovesReplayed += ReplayedMoves;
+	ReplayedMovesHistogram[GetBucket(ReplayBucketLimits, ReplayedMoves)]++;
+
+	INC_DWORD_STAT(STAT_CryMPCorrectionsReceived);
+	INC_DWORD_STAT_BY(STAT_CryMPMovesReplayed, ReplayedMoves);
+	CSV_CUSTOM_STAT(CryMPMovement, CorrectionsReceived, 1, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(CryMPMovement, MovesReplayed, ReplayedMoves, ECsvCustomStatOp::Accumulate);
+}
+
+void FCMPMovementTelemetry::AddCombineResult(ECMPCombineResult Result)
+{
+	switch (Result)
+	{
+	case ECMPCombineResult::Combined:
+		MovesCombined++;
+		INC_DWORD_STAT(STAT_CryMPMovesCombined);
+		CSV_CUSTOM_STAT(CryMPMovement, MovesCombined, 1, ECsvCustomStatOp::Accumulate);
+		break;
+	case ECMPCombineResult::RejectedGait:
+		CombineRejectedByGait++;
+		INC_DWORD_STAT(STAT_CryMPCombineRejectedByGait);
+		CSV_CUSTOM_STAT(CryMPMovement, CombineRejectedByGait, 1, ECsvCustomStatOp::Accumulate);
+		// Also counts as a rejection
+		[[fallthrough]];
+	case ECMPCombineResult::Rejected:
+		CombineRejected++;
+		INC_DWORD_STAT(STAT_CryMPCombineRejected);
+		CSV_CUSTOM_STAT(CryMPMovement, CombineRejected, 1, ECsvCustomStatOp::Accumulate);
+		break;
+	}
+}
+
+FString FCMPMovementTelemetry::ToString() const
+{
+	return FString::Printf(
+		TEXT("sent %u (max %.1fcm) [%s] | received %u, replayed %u [%s] | combined %u, rejected %u (gait %u)"),
+		CorrectionsSent, MaxCorrectionMagnitude,
+		*HistogramToString(CorrectionBucketLimits, CorrectionMagnitudeHistogram),
+		CorrectionsReceived, MovesReplayed, *HistogramToString(ReplayBucketLimits, ReplayedMovesHistogram),
+		MovesCombined, CombineRejected, CombineRejectedByGait);
+}
@@ -3,3 +3,51 @@
 
 #include "Player/CMPPlayerController.h"
 
+#include "Player/CMPCharacter.h"
+#include "System/CMPCharacterPoolSubsystem.h"
+#include "System/CMPSignificanceManager.h"
+
+
+void ACMPPlayerController::PlayerTick(float DeltaTime)
+{
+	Super::PlayerTick(DeltaTime);
+
+	UpdateSignificance();
+}
+
+void ACMPPlayerController::PawnLeavingGame()
+{
+	const auto Character = Cast<ACMPCharacter>(GetPawn());
+	const auto Pool = UCMPCharacterPoolSubsystem::Get(GetWorld());
+	if (!Character || !Pool)
+	{
+		Super::PawnLeavingGame();
+		return;
+	}
+
+	UnPossess();
+	Pool->ReleaseCharacter(Character);
+}
+
+void ACMPPlayerController::UpdateSignificance() const
+{
+	const auto World = GetWorld();
+	if (World->GetFirstPlayerController() != this) return;
+
+	const auto SignificanceManager = UCMPSignificanceManager::Get(World);
+	if (!SignificanceManager) return;
+
+	TArray<FTransform, TInlineAllocator<4>> Viewpoints;
+	for (auto Iterator = World->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		const APlayerController* PlayerController = Iterator->Get();
+		if (!PlayerController || !PlayerController->IsLocalController()) continue;
+
+		FVector ViewLocation;
+		FRotator ViewRotation;
+		PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+		Viewpoints.Emplace(ViewRotation, ViewLocation);
+	}
+
+	SignificanceManager->Update(Viewpoints);
+}
@@ -0,0 +1,126 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Player/CMPSnapshotInterpolation.h"
+
+#include "Algo/BinarySearch.h"
+
+
+namespace
+{
+	// Early arrivals pull the clock offset in quickly, late ones only nudge it, so a lag spike does not shift playback
+	constexpr double EarlyArrivalBlend = 0.5;
+	constexpr double LateArrivalBlend = 0.02;
+	constexpr double JitterBlend = 0.1;
+	constexpr double IntervalBlend = 0.1;
+}
+
+void FCMPSnapshotBuffer::Reset()
+{
+	Snapshots.Reset();
+	ClockOffset = 0.0;
+	Jitter = 0.0;
+	AverageInterval = 0.0;
+	bHasClockOffset = false;
+}
+
+bool FCMPSnapshotBuffer::AddSnapshot(const FCMPMovementSnapshot& Snapshot, double LocalTime,
+                                     const FCMPSnapshotInterpolationSettings& Settings)
+{
+	if (!Snapshots.IsEmpty())
+	{
+		const double ServerDelta = Snapshot.ServerTime - Snapshots.Last().ServerTime;
+		if (ServerDelta <= 0.0 && -ServerDelta < Settings.MaxSnapshotGap)
+		{
+			return false;
+		}
+
+		// Long silence or a server timestamp reset, start over from this snapshot
+		if (FMath::Abs(ServerDelta) > Settings.MaxSnapshotGap)
+		{
+			Reset();
+		}
+		else
+		{
+			AverageInterval = bHasClockOffset && AverageInterval > 0.0
+				                  ? FMath::Lerp(AverageInterval, ServerDelta, IntervalBlend)
+				                  : ServerDelta;
+		}
+	}
+
+	const double Offset = LocalTime - Snapshot.ServerTime;
+	if (!bHasClockOffset)
+	{
+		ClockOffset = Offset;
+		bHasClockOffset = true;
+	}
+	else
+	{
+		const double Deviation = Offset - ClockOffset;
+		ClockOffset += Deviation * (Deviation < 0.0 ? EarlyArrivalBlend : LateArrivalBlend);
+		Jitter = FMath::Lerp(Jitter, FMath::Abs(Deviation), JitterBlend);
+	}
+
+	if (Snapshots.Num() == MaxSnapshots)
+	{
+		Snapshots.RemoveAt(0, 1, EAllowShrinking::No);
+	}
+	Snapshots.Add(Snapshot);
+
+	return true;
+}
+
+double FCMPSnapshotBuffer::GetDelay(const FCMPSnapshotInterpolationSettings& Settings) const
+{
+	return FMath::Clamp(AverageInterval + Jitter * Settings.JitterMultiplier, Settings.MinDelay, Settings.MaxDelay);
+}
+
+bool FCMPSnapshotBuffer::Sample(double LocalTime, const FCMPSnapshotInterpolationSettings& Settings,
+                                FCMPMovementSnapshot& OutState)
+{
+	if (Snapshots.IsEmpty()) return false;
+
+	const double PlaybackTime = LocalTime - ClockOffset - GetDelay(Settings);
+
+	const FCMPMovementSnapshot& Newest = Snapshots.Last();
+	if (PlaybackTime >= Newest.ServerTime)
+	{
+		const double ExtrapolationTime = FMath::Min(PlaybackTime - Newest.ServerTime,
+		                                            double(Settings.MaxExtrapolationTime));
+
+		OutState = Newest;
+		OutState.ServerTime = PlaybackTime;
+		OutState.Location += Newest.Velocity * ExtrapolationTime + 0.5 * Newest.Acceleration * FMath::Square(
+			ExtrapolationTime);
+		OutState.Velocity += Newest.Acceleration * ExtrapolationTime;
+
+		// Keep the newest snapshot as the start of the next segment
+		Snapshots.RemoveAt(0, Snapshots.Num() - 1, EAllowShrinking::No);
+		return true;
+	}
+
+	if (PlaybackTime <= Snapshots[0].ServerTime)
+	{
+		OutState = Snapshots[0];
+		return true;
+	}
+
+	const int32 ToIndex = Algo::UpperBoundBy(Snapshots, PlaybackTime, &FCMPMovementSnapshot::ServerTime);
+	const FCMPMovementSnapshot& From = Snapshots[ToIndex - 1];
+	const FCMPMovementSnapshot& To = Snapshots[ToIndex];
+
+	const double Duration = To.ServerTime - From.ServerTime;
+	const double Alpha = (PlaybackTime - From.ServerTime) / Duration;
+
+	// Cubic Hermite with the snapshot velocities as tangents
+	OutState.ServerTime = PlaybackTime;
+	OutState.Location = FMath::CubicInterp(From.Location, From.Velocity * Duration, To.Location,
+	                                       To.Velocity * Duration, Alpha);
+	OutState.Velocity = FMath::CubicInterpDerivative(From.Location, From.Velocity * Duration, To.Location,
+	                                                 To.Velocity * Duration, Alpha) / Duration;
+	OutState.Rotation = FQuat::Slerp(From.Rotation, To.Rotation, Alpha);
+	OutState.Acceleration = FMath::Lerp(From.Acceleration, To.Acceleration, Alpha);
+
+	Snapshots.RemoveAt(0, ToIndex - 1, EAllowShrinking::No);
+	return true;
+}
@@ -0,0 +1,418 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Player/CMPWeaponFireComponent.h"
+
+#include "EngineUtils.h"
+#include "GameFramework/GameStateBase.h"
+#include "GameFramework/PlayerState.h"
+#include "Guns/GunParent.h"
+#include "Net/UnrealNetwork.h"
+#include "Player/CMPCharacter.h"
+#include "Player/CMPCharacterMovementComponent.h"
+
+
+namespace CryMP::Fire
+{
+	float BatchWindow = 0.05f;
+	static FAutoConsoleVariableRef CVarCryMPFireBatchWindow(TEXT("CryMP.Fire.BatchWindow"), BatchWindow, TEXT("Seconds the owner collects shots before sending them in one ServerFire. 0 sends once per frame."), ECVF_Default);
+
+	float FireRateTolerance = 0.9f;
+	static FAutoConsoleVariableRef CVarCryMPFireRateTolerance(TEXT("CryMP.Fire.FireRateTolerance"), FireRateTolerance, TEXT("Fraction of the fire interval two accepted shots must at least be apart."), ECVF_Default);
+
+	float MaxShotCredit = 4.f;
+	static FAutoConsoleVariableRef CVarCryMPFireMaxShotCredit(TEXT("CryMP.Fire.MaxShotCredit"), MaxShotCredit, TEXT("Shots the server lets arrive at once after a pause, covers batching and network jitter."), ECVF_Default);
+
+	float MaxShotAge = 1.f;
+	static FAutoConsoleVariableRef CVarCryMPFireMaxShotAge(TEXT("CryMP.Fire.MaxShotAge"), MaxShotAge, TEXT("Seconds a shot timestamp may be behind the server clock."), ECVF_Default);
+
+	float MaxTimeAhead = 0.25f;
+	static FAutoConsoleVariableRef CVarCryMPFireMaxTimeAhead(TEXT("CryMP.Fire.MaxTimeAhead"), MaxTimeAhead, TEXT("Seconds a shot timestamp may be ahead of the server clock, covers the client clock estimate."), ECVF_Default);
+}
+
+namespace
+{
+	// Shot times travel in 0.1 ms ticks
+	constexpr double ShotTimeTicksPerSecond = 10000.0;
+}
+
+FVector FCMPShot::GetDirection(const AGunParent& Gun, bool bAiming, uint32 Salt) const
+{
+	// Consecutive seeds would give correlated first rolls
+	FRandomStream Stream(int32(MurmurFinalize32(Salt ^ Seed)));
+	return Stream.VRandCone(Aim.Vector(), FMath::DegreesToRadians(Gun.GetSpread(bAiming)));
+}
+
+bool FCMPShotBatch::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	// Count minus one, a batch is never empty
+	uint8 NumShots = uint8(FMath::Clamp(Shots.Num(), 1, MaxShots) - 1);
+	Ar.SerializeBits(&NumShots, 4);
+
+	if (Ar.IsLoading())
+	{
+		Shots.SetNum(NumShots + 1);
+	}
+
+	uint64 PreviousTicks = 0;
+	for (int32 Index = 0; Index < Shots.Num(); Index++)
+	{
+		FCMPShot& Shot = Shots[Index];
+
+		uint64 Ticks = 0;
+		if (Ar.IsSaving())
+		{
+			Ticks = uint64(FMath::Max<int64>(FMath::RoundToInt64(Shot.Time * ShotTimeTicksPerSecond), 0));
+		}
+
+		if (Index == 0)
+		{
+			// 64 bits, 32 would run out of 0.1 ms ticks after five days of server uptime
+			Ar.SerializeIntPacked64(Ticks);
+		}
+		else
+		{
+			// Shots are in firing order, later ones only send how long after the previous one they were
+			const uint64 Delta = Ticks - FMath::Min(Ticks, PreviousTicks);
+			uint32 DeltaTicks = Ar.IsSaving() ? uint32(FMath::Min<uint64>(Delta, MAX_uint32)) : 0;
+			Ar.SerializeIntPacked(DeltaTicks);
+			Ticks = PreviousTicks + DeltaTicks;
+		}
+		PreviousTicks = Ticks;
+
+		uint16 Pitch = 0;
+		uint16 Yaw = 0;
+		if (Ar.IsSaving())
+		{
+			Pitch = FRotator::CompressAxisToShort(Shot.Aim.Pitch);
+			Yaw = FRotator::CompressAxisToShort(Shot.Aim.Yaw);
+		}
+		Ar << Pitch << Yaw;
+		Ar << Shot.Seed;
+
+		if (Ar.IsLoading())
+		{
+			Shot.Time = double(Ticks) / ShotTimeTicksPerSecond;
+			Shot.Aim = FRotator(FRotator::DecompressAxisFromShort(Pitch), FRotator::DecompressAxisFromShort(Yaw), 0.f);
+		}
+	}
+
+	uint32 ViewDelayMs = Ar.IsSaving() ? uint32(FMath::Max(FMath::RoundToInt(ViewDelay * 1000.f), 0)) : 0;
+	Ar.SerializeIntPacked(ViewDelayMs);
+	ViewDelay = float(ViewDelayMs) / 1000.f;
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+UCMPWeaponFireComponent::UCMPWeaponFireComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+
+	SetIsReplicatedByDefault(true);
+}
+
+void UCMPWeaponFireComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (GetOwnerRole() == ROLE_Authority)
+	{
+		ResetFiring();
+	}
+}
+
+void UCMPWeaponFireComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(UCMPWeaponFireComponent, SpreadSalt, COND_OwnerOnly);
+}
+
+void UCMPWeaponFireComponent::TickComponent(float DeltaTime, ELevelTick TickType,
+                                            FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	const auto Character = GetCharacter();
+	const auto Gun = GetGun();
+	if (!Character || !Gun || !Character->IsLocallyControlled() || Character->IsPooled())
+	{
+		bTriggerHeld = false;
+		bTriggerPulled = false;
+		ShotsLeftInBurst = 0;
+		SendPendingShots();
+		SetComponentTickEnabled(false);
+		return;
+	}
+
+	const double Now = GetServerTime();
+	const EFireModes FireMode = Gun->GetCurrentFireMode();
+
+	if (bTriggerPulled)
+	{
+		bTriggerPulled = false;
+
+		// Right away, unless the previous shot is still cycling
+		NextShotTime = FMath::Max(NextShotTime, Now);
+		ShotsLeftInBurst = FireMode == EFireModes::EFM_Semi ? 1 : FireMode == EFireModes::EFM_Burst ? Gun->GetBurstCount() : 0;
+	}
+
+	auto IsFiring = [this, FireMode]()
+	{
+		return ShotsLeftInBurst > 0 || (FireMode == EFireModes::EFM_Auto && bTriggerHeld);
+	};
+
+	// Every shot that came due since the last frame, each at its own time
+	while (IsFiring() && NextShotTime <= Now)
+	{
+		if (FireMode == EFireModes::EFM_Safe || !Gun->ConsumeAmmo())
+		{
+			ShotsLeftInBurst = 0;
+			bTriggerHeld = false;
+			break;
+		}
+
+		FireShot(*Gun, NextShotTime);
+		NextShotTime += Gun->GetFireInterval();
+		ShotsLeftInBurst = FMath::Max(ShotsLeftInBurst - 1, 0);
+	}
+
+	const bool bFiring = IsFiring();
+	if (!PendingShots.Shots.IsEmpty() &&
+		(!bFiring || GetWorld()->GetTimeSeconds() - PendingSince >= CryMP::Fire::BatchWindow))
+	{
+		SendPendingShots();
+	}
+
+	if (!bFiring && PendingShots.Shots.IsEmpty())
+	{
+		SetComponentTickEnabled(false);
+	}
+}
+
+void UCMPWeaponFireComponent::StartFire()
+{
+	bTriggerHeld = true;
+	bTriggerPulled = true;
+	SetComponentTickEnabled(true);
+}
+
+void UCMPWeaponFireComponent::StopFire()
+{
+	bTriggerHeld = false;
+}
+
+void UCMPWeaponFireComponent::ResetFiring()
+{
+	LastAcceptedShotTime = -1.0;
+	LastAcceptedServerTime = 0.0;
+	LastCreditTime = 0.0;
+	ShotCredit = 0.f;
+	LastAcceptedSeed = 0;
+	bHasAcceptedShot = false;
+
+	SpreadSalt = FMath::Rand32();
+}
+
+ACMPCharacter* UCMPWeaponFireComponent::GetCharacter() const
+{
+	return Cast<ACMPCharacter>(GetOwner());
+}
+
+AGunParent* UCMPWeaponFireComponent::GetGun() const
+{
+	const auto Character = GetCharacter();
+	return Character ? Character->GetCurrentWeapon() : nullptr;
+}
+
+double UCMPWeaponFireComponent::GetServerTime() const
+{
+	const auto GameState = GetWorld()->GetGameState();
+	return GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+}
+
+void UCMPWeaponFireComponent::FireShot(AGunParent& Gun, double ShotTime)
+{
+	if (PendingShots.Shots.Num() >= FCMPShotBatch::MaxShots)
+	{
+		SendPendingShots();
+	}
+
+	if (PendingShots.Shots.IsEmpty())
+	{
+		PendingSince = GetWorld()->GetTimeSeconds();
+	}
+
+	const auto Character = GetCharacter();
+	const FRotator ControlRotation = Character->GetControlRotation();
+
+	FCMPShot& Shot = PendingShots.Shots.AddDefaulted_GetRef();
+	Shot.Time = ShotTime;
+	Shot.Aim = FRotator(ControlRotation.Pitch, ControlRotation.Yaw, 0.f);
+	Shot.Seed = NextSeed++;
+
+	Character->AddControllerPitchInput(Gun.GetRecoilPerShot());
+	PlayFireMontage();
+}
+
+void UCMPWeaponFireComponent::SendPendingShots()
+{
+	if (PendingShots.Shots.IsEmpty()) return;
+
+	// A listen server host validates its own shots without the round trip
+	if (GetOwnerRole() == ROLE_Authority)
+	{
+		ProcessShots(PendingShots);
+	}
+	else
+	{
+		PendingShots.ViewDelay = GetViewDelay();
+		ServerFire(PendingShots);
+	}
+
+	PendingShots.Shots.Reset();
+}
+
+void UCMPWeaponFireComponent::ServerFire_Implementation(const FCMPShotBatch& Batch)
+{
+	ProcessShots(Batch);
+}
+
+void UCMPWeaponFireComponent::ProcessShots(const FCMPShotBatch& Batch)
+{
+	const auto Character = GetCharacter();
+	const auto Gun = GetGun();
+	if (!Character || !Gun || Character->IsPooled()) return;
+
+	// The host took its rounds when firing
+	const bool bAmmoConsumed = Character->IsLocallyControlled();
+	const double ServerTime = GetServerTime();
+	const FVector Origin = Character->GetPawnViewLocation();
+
+	uint8 NumAccepted = 0;
+	for (const auto& Shot : Batch.Shots)
+	{
+		if (!ValidateShot(*Gun, Shot, ServerTime)) continue;
+		if (!bAmmoConsumed && !Gun->ConsumeAmmo()) break;
+
+		NumAccepted++;
+
+		const FVector Direction = Shot.GetDirection(*Gun, Character->IsAiming(), SpreadSalt);
+		FCMPRewindHit Hit;
+		TraceShot(*Gun, Shot, Batch.ViewDelay, Origin, Direction, Hit);
+
+		OnShotAccepted.Broadcast(Character, Shot, Origin, Direction, Hit);
+	}
+
+	if (NumAccepted > 0)
+	{
+		Character->MarkNetActive();
+		MulticastShotsFired(NumAccepted);
+	}
+}
+
+float UCMPWeaponFireComponent::GetViewDelay() const
+{
+	float ViewDelay = 0.f;
+
+	// Updates left the server half a round trip before they arrived
+	const auto Character = GetCharacter();
+	if (const auto PlayerState = Character ? Character->GetPlayerState() : nullptr)
+	{
+		ViewDelay += PlayerState->GetPingInMilliseconds() / 2000.f;
+	}
+
+	float PlaybackDelay = 0.f;
+	int32 NumProxies = 0;
+	for (TActorIterator<ACMPCharacter> It(GetWorld()); It; ++It)
+	{
+		if (It->GetLocalRole() != ROLE_SimulatedProxy) continue;
+
+		if (const auto Movement = Cast<UCMPCharacterMovementComponent>(It->GetCharacterMovement()))
+		{
+			PlaybackDelay += Movement->GetSnapshotDelay();
+			NumProxies++;
+		}
+	}
+
+	return NumProxies > 0 ? ViewDelay + PlaybackDelay / NumProxies : ViewDelay;
+}
+
+void UCMPWeaponFireComponent::TraceShot(const AGunParent& Gun, const FCMPShot& Shot, float ViewDelay,
+                                        const FVector& Origin, const FVector& Direction, FCMPRewindHit& OutHit) const
+{
+	const auto LagCompensation = UCMPLagCompensationSubsystem::Get(GetWorld());
+	if (!LagCompensation) return;
+
+	float Distance = Gun.GetRange();
+
+	// Static geometry does not move, it is traced where it is now
+	FHitResult WorldHit;
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(CryMPShot), false, GetOwner());
+	if (GetWorld()->LineTraceSingleByObjectType(WorldHit, Origin, Origin + Direction * Distance,
+	                                            FCollisionObjectQueryParams(ECC_WorldStatic), Params))
+	{
+		Distance = WorldHit.Distance;
+	}
+
+	LagCompensation->TraceRewound(Shot.Time - ViewDelay, Origin, Direction, Distance, GetOwner(), OutHit);
+}
+
+bool UCMPWeaponFireComponent::ValidateShot(const AGunParent& Gun, const FCMPShot& Shot, double ServerTime)
+{
+	if (Gun.GetCurrentFireMode() == EFireModes::EFM_Safe) return false;
+
+	const float FireInterval = Gun.GetFireInterval();
+
+	if (bHasAcceptedShot)
+	{
+		// Duplicated or reordered batches, the sequence wraps
+		const int32 SeedGap = int16(uint16(Shot.Seed - LastAcceptedSeed));
+		if (SeedGap <= 0) return false;
+
+		// Seeds skipped belong to shots lost with a batch, no more than the server clock let the owner fire since
+		const double SinceLastAccepted = FMath::Max(ServerTime - LastAcceptedServerTime, 0.0);
+		const double MinShotSpacing = FireInterval * CryMP::Fire::FireRateTolerance;
+		const int32 MaxSeedGap = 1 + FMath::FloorToInt32(FMath::Min(SinceLastAccepted / MinShotSpacing, double(MAX_int16))) +
+			FMath::CeilToInt32(CryMP::Fire::MaxShotCredit);
+		if (SeedGap > MaxSeedGap) return false;
+	}
+
+	if (Shot.Time > ServerTime + CryMP::Fire::MaxTimeAhead || Shot.Time < ServerTime - CryMP::Fire::MaxShotAge) return false;
+
+	if (bHasAcceptedShot && Shot.Time - LastAcceptedShotTime < FireInterval * CryMP::Fire::FireRateTolerance) return false;
+
+	// Spacing alone trusts the client clock, the credit only grows with the server clock
+	ShotCredit = FMath::Min(ShotCredit + float((ServerTime - LastCreditTime) / FireInterval), CryMP::Fire::MaxShotCredit);
+	LastCreditTime = ServerTime;
+	if (ShotCredit < 1.f) return false;
+
+	ShotCredit -= 1.f;
+	LastAcceptedShotTime = Shot.Time;
+	LastAcceptedServerTime = ServerTime;
+	LastAcceptedSeed = Shot.Seed;
+	bHasAcceptedShot = true;
+	return true;
+}
+
+void UCMPWeaponFireComponent::MulticastShotsFired_Implementation(uint8 NumShots)
+{
+	const auto Character = GetCharacter();
+	if (!Character || Character->IsLocallyControlled() || GetNetMode() == NM_DedicatedServer) return;
+
+	PlayFireMontage();
+}
+
+void UCMPWeaponFireComponent::PlayFireMontage() const
+{
+	const auto Character = GetCharacter();
+	const auto Gun = GetGun();
+	if (!Character || !Gun || !Gun->FireMontage) return;
+
+	if (const auto AnimInstance = Character->GetMesh()->GetAnimInstance())
+	{
+		AnimInstance->Montage_Play(Gun->FireMontage);
+	}
+}
@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "System/CMPCharacterPoolSubsystem.h"
+
+#include "Player/CMPCharacter.h"
+
+
+namespace CryMP::Pool
+{
+	int32 Enable = 1;
+	static FAutoConsoleVariableRef CVarCryMPPoolEnable(TEXT("CryMP.Pool.Enable"), Enable, TEXT("Recycle characters and their loadouts on respawn instead of destroying and spawning them."), ECVF_Default);
+
+	int32 MaxPooledPerClass = 16;
+	static FAutoConsoleVariableRef CVarCryMPPoolMaxPooledPerClass(TEXT("CryMP.Pool.MaxPooledPerClass"), MaxPooledPerClass, TEXT("Released characters beyond this many per class are destroyed."), ECVF_Default);
+}
+
+bool UCMPCharacterPoolSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	if (!Super::ShouldCreateSubsystem(Outer)) return false;
+
+	// Clients only ever see the server's pooled characters through replication
+	const UWorld* World = Outer ? Outer->GetWorld() : nullptr;
+	return World && World->GetNetMode() != NM_Client;
+}
+
+void UCMPCharacterPoolSubsystem::Deinitialize()
+{
+	Pools.Reset();
+
+	Super::Deinitialize();
+}
+
+UCMPCharacterPoolSubsystem* UCMPCharacterPoolSubsystem::Get(const UWorld* World)
+{
+	return World && CryMP::Pool::Enable ? World->GetSubsystem<UCMPCharacterPoolSubsystem>() : nullptr;
+}
+
+bool UCMPCharacterPoolSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+ACMPCharacter* UCMPCharacterPoolSubsystem::AcquireCharacter(UClass* CharacterClass, const FTransform& SpawnTransform)
+{
+	FCMPCharacterPoolList* Pool = Pools.Find(CharacterClass);
+	if (!Pool) return nullptr;
+
+	while (Pool->Characters.Num() > 0)
+	{
+		ACMPCharacter* Character = Pool->Characters.Pop(EAllowShrinking::No);
+		if (IsValid(Character))
+		{
+			Character->AcquireFromPool(SpawnTransform);
+			return Character;
+		}
+	}
+
+	return nullptr;
+}
+
+void UCMPCharacterPoolSubsystem::ReleaseCharacter(ACMPCharacter* Character)
+{
+	if (!IsValid(Character) || Character->IsPooled()) return;
+
+	FCMPCharacterPoolList& Pool = Pools.FindOrAdd(Character->GetClass());
+	if (Pool.Characters.Num() >= CryMP::Pool::MaxPooledPerClass)
+	{
+		Character->Destroy();
+		return;
+	}
+
+	Character->ReleaseToPool();
+	Pool.Characters.Add(Character);
+}
+
+void UCMPCharacterPoolSubsystem::PrewarmCharacters(UClass* CharacterClass, int32 Count)
+{
+	if (!CharacterClass || !CharacterClass->IsChildOf<ACMPCharacter>()) return;
+
+	FActorSpawnParameters Params;
+	Params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	Params.ObjectFlags |= RF_Transient;
+
+	for (int32 Index = GetNumPooled(CharacterClass); Index < FMath::Min(Count, CryMP::Pool::MaxPooledPerClass); Index++)
+	{
+		if (const auto Character = GetWorld()->SpawnActor<ACMPCharacter>(CharacterClass, FTransform::Identity, Params))
+		{
+			ReleaseCharacter(Character);
+		}
+	}
+}
+
+int32 UCMPCharacterPoolSubsystem::GetNumPooled(UClass* CharacterClass) const
+{
+	const FCMPCharacterPoolList* Pool = Pools.Find(CharacterClass);
+	return Pool ? Pool->Characters.Num() : 0;
+}
@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "System/CMPGunAssemblyCache.h"
+
+#include "Engine/GameInstance.h"
+
+
+namespace CryMP::Guns
+{
+	int32 EnableAssemblyCache = 1;
+	static FAutoConsoleVariableRef CVarCryMPGunsEnableAssemblyCache(TEXT("CryMP.Guns.EnableAssemblyCache"), EnableAssemblyCache, TEXT("Assemble guns from the cached result of an earlier gun with the same class and parts."), ECVF_Default);
+}
+
+FCMPGunAssemblyKey::FCMPGunAssemblyKey(const UClass* InGunClass, TArray<FCMPGunAssemblyPart>&& InParts)
+	: GunClass(InGunClass), Parts(MoveTemp(InParts))
+{
+	Hash = GetTypeHash(GunClass);
+	for (const auto& Part : Parts)
+	{
+		Hash = HashCombine(Hash, GetTypeHash(Part.PartClass));
+		Hash = HashCombine(Hash, GetTypeHash(Part.BaseIndex));
+		Hash = HashCombine(Hash, GetTypeHash(Part.BaseSocket));
+		Hash = HashCombine(Hash, GetTypeHash(Part.bActioned));
+	}
+}
+
+UCMPGunAssemblyCache* UCMPGunAssemblyCache::Get(const UObject* WorldContextObject)
+{
+	if (!CryMP::Guns::EnableAssemblyCache) return nullptr;
+
+	const UWorld* World = WorldContextObject ? WorldContextObject->GetWorld() : nullptr;
+	const UGameInstance* GameInstance = World ? World->GetGameInstance() : nullptr;
+	return GameInstance ? GameInstance->GetSubsystem<UCMPGunAssemblyCache>() : nullptr;
+}
+
+const FCMPGunAssembly* UCMPGunAssemblyCache::Find(const FCMPGunAssemblyKey& Key) const
+{
+	return Assemblies.Find(Key);
+}
+
+void UCMPGunAssemblyCache::Add(FCMPGunAssemblyKey&& Key, FCMPGunAssembly&& Assembly)
+{
+	Assemblies.Add(MoveTemp(Key), MoveTemp(Assembly));
+}
+
+void UCMPGunAssemblyCache::Deinitialize()
+{
+	Assemblies.Reset();
+
+	Super::Deinitialize();
+}
@@ -0,0 +1,422 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "System/CMPLagCompensationSubsystem.h"
+
+#include "Components/CapsuleComponent.h"
+#include "Player/CMPCharacter.h"
+
+
+namespace CryMP::LagCompensation
+{
+	int32 Enable = 1;
+	static FAutoConsoleVariableRef CVarCryMPLagCompensationEnable(TEXT("CryMP.LagCompensation.Enable"), Enable, TEXT("Validate shots against character hitboxes as the shooter saw them."), ECVF_Default);
+
+	float MaxRewindTime = 0.5f;
+	static FAutoConsoleVariableRef CVarCryMPLagCompensationMaxRewindTime(TEXT("CryMP.LagCompensation.MaxRewindTime"), MaxRewindTime, TEXT("Seconds a trace may look into the past, shooters with more latency have to lead their targets."), ECVF_Default);
+}
+
+bool FCMPHitboxHistory::FindFrames(double Time, int32& OutFromSlot, int32& OutToSlot, float& OutAlpha) const
+{
+	if (NumFrames == 0) return false;
+
+	OutAlpha = 0.f;
+
+	const int32 NewestSlot = GetSlot(0);
+	const int32 OldestSlot = GetSlot(NumFrames - 1);
+	if (Time >= FrameTimes[NewestSlot] || Time <= FrameTimes[OldestSlot])
+	{
+		OutFromSlot = OutToSlot = Time >= FrameTimes[NewestSlot] ? NewestSlot : OldestSlot;
+		return true;
+	}
+
+	// Youngest frame at or before Time, frame times fall with age
+	int32 Low = 1;
+	int32 High = NumFrames - 1;
+	while (Low < High)
+	{
+		const int32 Mid = (Low + High) / 2;
+		if (FrameTimes[GetSlot(Mid)] <= Time)
+		{
+			High = Mid;
+		}
+		else
+		{
+			Low = Mid + 1;
+		}
+	}
+
+	OutFromSlot = GetSlot(Low);
+	OutToSlot = GetSlot(Low - 1);
+
+	const double Duration = FrameTimes[OutToSlot] - FrameTimes[OutFromSlot];
+	OutAlpha = Duration > 0.0 ? float((Time - FrameTimes[OutFromSlot]) / Duration) : 0.f;
+	return true;
+}
+
+bool UCMPLagCompensationSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	if (!Super::ShouldCreateSubsystem(Outer)) return false;
+
+	const UWorld* World = Outer ? Outer->GetWorld() : nullptr;
+	return World && World->GetNetMode() != NM_Client;
+}
+
+void UCMPLagCompensationSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (!CryMP::LagCompensation::Enable) return;
+
+	const double Time = GetWorld()->GetTimeSeconds();
+	for (FCMPHitboxHistory& History : Histories)
+	{
+		if (!IsValid(History.Character)) continue;
+
+		// A pooled character comes back somewhere else, nothing before that can be hit
+		if (History.Character->IsPooled())
+		{
+			History.NumFrames = 0;
+			continue;
+		}
+
+		RecordFrame(History, Time);
+	}
+}
+
+TStatId UCMPLagCompensationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCMPLagCompensationSubsystem, STATGROUP_Tickables);
+}
+
+bool UCMPLagCompensationSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+UCMPLagCompensationSubsystem* UCMPLagCompensationSubsystem::Get(const UWorld* World)
+{
+	return World && CryMP::LagCompensation::Enable ? World->GetSubsystem<UCMPLagCompensationSubsystem>() : nullptr;
+}
+
+void UCMPLagCompensationSubsystem::RegisterCharacter(ACMPCharacter* Character)
+{
+	if (!Character || Histories.ContainsByPredicate([Character](const FCMPHitboxHistory& History)
+	{
+		return History.Character == Character;
+	}))
+	{
+		return;
+	}
+
+	FCMPHitboxHistory& History = Histories.AddDefaulted_GetRef();
+	History.Character = Character;
+
+	// The movement capsule, its segment is taken from the capsule component
+	History.StartBoneIndices.Add(INDEX_NONE);
+	History.EndBoneIndices.Add(INDEX_NONE);
+	History.Radii.Add(Character->GetCapsuleComponent()->GetScaledCapsuleRadius());
+
+	const USkeletalMeshComponent* Mesh = Character->GetMesh();
+	for (const FCMPHitboxCapsule& Hitbox : Character->GetHitboxes())
+	{
+		const int32 StartBoneIndex = Mesh ? Mesh->GetBoneIndex(Hitbox.StartBone) : INDEX_NONE;
+		if (StartBoneIndex == INDEX_NONE) continue;
+
+		const int32 EndBoneIndex = Mesh->GetBoneIndex(Hitbox.EndBone);
+		History.StartBoneIndices.Add(StartBoneIndex);
+		History.EndBoneIndices.Add(EndBoneIndex != INDEX_NONE ? EndBoneIndex : StartBoneIndex);
+		History.Radii.Add(Hitbox.Radius);
+	}
+
+	History.NumHitboxes = History.Radii.Num();
+	History.NumPadded = Align(History.NumHitboxes, 4);
+	History.Radii.SetNumZeroed(History.NumPadded);
+
+	for (TArray<float>* Column : {&History.StartX, &History.StartY, &History.StartZ, &History.EndX, &History.EndY, &History.EndZ})
+	{
+		Column->SetNumZeroed(FCMPHitboxHistory::MaxFrames * History.NumPadded);
+	}
+}
+
+void UCMPLagCompensationSubsystem::UnregisterCharacter(ACMPCharacter* Character)
+{
+	Histories.RemoveAllSwap([Character](const FCMPHitboxHistory& History)
+	{
+		return History.Character == Character;
+	});
+}
+
+void UCMPLagCompensationSubsystem::RecordFrame(FCMPHitboxHistory& History, double Time) const
+{
+	const int32 Slot = History.Head;
+	const int32 Base = Slot * History.NumPadded;
+
+	const UCapsuleComponent* Capsule = History.Character->GetCapsuleComponent();
+	const FVector Center = Capsule->GetComponentLocation();
+	const float CapsuleRadius = Capsule->GetScaledCapsuleRadius();
+	const FVector Axis = Capsule->GetUpVector() * (Capsule->GetScaledCapsuleHalfHeight() - CapsuleRadius);
+
+	float BoundRadius = 0.f;
+	auto WriteHitbox = [&History, Base, &Center, &BoundRadius](int32 Hitbox, const FVector& Start, const FVector& End)
+	{
+		History.StartX[Base + Hitbox] = float(Start.X);
+		History.StartY[Base + Hitbox] = float(Start.Y);
+		History.StartZ[Base + Hitbox] = float(Start.Z);
+		History.EndX[Base + Hitbox] = float(End.X);
+		History.EndY[Base + Hitbox] = float(End.Y);
+		History.EndZ[Base + Hitbox] = float(End.Z);
+
+		const double Reach = FMath::Max(FVector::Dist(Start, Center), FVector::Dist(End, Center));
+		BoundRadius = FMath::Max(BoundRadius, float(Reach) + History.Radii[Hitbox]);
+	};
+
+	History.Radii[0] = CapsuleRadius;
+	WriteHitbox(0, Center - Axis, Center + Axis);
+
+	bool bBonesPosed = false;
+	const USkeletalMeshComponent* Mesh = History.Character->GetMesh();
+	if (Mesh && History.NumHitboxes > 1)
+	{
+		bBonesPosed = true;
+
+		// One component transform for every bone instead of a world space query each
+		const TArray<FTransform>& Pose = Mesh->GetComponentSpaceTransforms();
+		const FTransform& ComponentTransform = Mesh->GetComponentTransform();
+
+		for (int32 Hitbox = 1; Hitbox < History.NumHitboxes; Hitbox++)
+		{
+			const int32 StartBoneIndex = History.StartBoneIndices[Hitbox];
+			const int32 EndBoneIndex = History.EndBoneIndices[Hitbox];
+			if (!Pose.IsValidIndex(StartBoneIndex) || !Pose.IsValidIndex(EndBoneIndex))
+			{
+				// No pose yet, collapsed inside the movement capsule rather than left at a stale frame
+				WriteHitbox(Hitbox, Center, Center);
+				bBonesPosed = false;
+				continue;
+			}
+
+			WriteHitbox(Hitbox, ComponentTransform.TransformPosition(Pose[StartBoneIndex].GetLocation()),
+			            ComponentTransform.TransformPosition(Pose[EndBoneIndex].GetLocation()));
+		}
+	}
+
+	History.FrameTimes[Slot] = Time;
+	History.bBonesPosed[Slot] = bBonesPosed;
+	History.BoundX[Slot] = float(Center.X);
+	History.BoundY[Slot] = float(Center.Y);
+	History.BoundZ[Slot] = float(Center.Z);
+	History.BoundRadius[Slot] = BoundRadius;
+
+	History.Head = (History.Head + 1) % FCMPHitboxHistory::MaxFrames;
+	History.NumFrames = FMath::Min(History.NumFrames + 1, FCMPHitboxHistory::MaxFrames);
+}
+
+bool UCMPLagCompensationSubsystem::TraceRewound(double Time, const FVector& Origin, const FVector& Direction,
+                                                float Distance, const AActor* IgnoredActor, FCMPRewindHit& OutHit)
+{
+	OutHit = FCMPRewindHit();
+	if (Histories.IsEmpty() || Distance <= 0.f) return false;
+
+	const double Now = GetWorld()->GetTimeSeconds();
+	Time = FMath::Clamp(Time, Now - CryMP::LagCompensation::MaxRewindTime, Now);
+
+	// Bounding spheres of every character at Time
+	for (TArray<float>* Column : {&CandidateX, &CandidateY, &CandidateZ, &CandidateRadius})
+	{
+		Column->Reset();
+	}
+	CandidateHistories.Reset();
+
+	for (int32 HistoryIndex = 0; HistoryIndex < Histories.Num(); HistoryIndex++)
+	{
+		const FCMPHitboxHistory& History = Histories[HistoryIndex];
+		if (!History.Character || History.Character == IgnoredActor) continue;
+
+		int32 FromSlot, ToSlot;
+		float Alpha;
+		if (!History.FindFrames(Time, FromSlot, ToSlot, Alpha)) continue;
+
+		CandidateX.Add(FMath::Lerp(History.BoundX[FromSlot], History.BoundX[ToSlot], Alpha));
+		CandidateY.Add(FMath::Lerp(History.BoundY[FromSlot], History.BoundY[ToSlot], Alpha));
+		CandidateZ.Add(FMath::Lerp(History.BoundZ[FromSlot], History.BoundZ[ToSlot], Alpha));
+		CandidateRadius.Add(FMath::Max(History.BoundRadius[FromSlot], History.BoundRadius[ToSlot]));
+		CandidateHistories.Add(HistoryIndex);
+	}
+
+	const int32 NumCandidates = CandidateHistories.Num();
+	if (NumCandidates == 0) return false;
+
+	const int32 NumPadded = Align(NumCandidates, 4);
+	for (TArray<float>* Column : {&CandidateX, &CandidateY, &CandidateZ, &CandidateRadius})
+	{
+		Column->SetNumZeroed(NumPadded, EAllowShrinking::No);
+	}
+
+	const VectorRegister4Float OriginX = VectorSetFloat1(float(Origin.X));
+	const VectorRegister4Float OriginY = VectorSetFloat1(float(Origin.Y));
+	const VectorRegister4Float OriginZ = VectorSetFloat1(float(Origin.Z));
+	const VectorRegister4Float DirectionX = VectorSetFloat1(float(Direction.X));
+	const VectorRegister4Float DirectionY = VectorSetFloat1(float(Direction.Y));
+	const VectorRegister4Float DirectionZ = VectorSetFloat1(float(Direction.Z));
+	const VectorRegister4Float Length = VectorSetFloat1(Distance);
+	const VectorRegister4Float Zero = VectorZeroFloat();
+
+	for (int32 Index = 0; Index < NumPadded; Index += 4)
+	{
+		const VectorRegister4Float ToCenterX = VectorSubtract(VectorLoad(&CandidateX[Index]), OriginX);
+		const VectorRegister4Float ToCenterY = VectorSubtract(VectorLoad(&CandidateY[Index]), OriginY);
+		const VectorRegister4Float ToCenterZ = VectorSubtract(VectorLoad(&CandidateZ[Index]), OriginZ);
+
+		// Closest point of the ray segment to each center
+		const VectorRegister4Float Along = VectorMin(VectorMax(
+			VectorMultiplyAdd(ToCenterZ, DirectionZ, VectorMultiplyAdd(ToCenterY, DirectionY, VectorMultiply(ToCenterX, DirectionX))),
+			Zero), Length);
+
+		const VectorRegister4Float OffsetX = VectorNegateMultiplyAdd(DirectionX, Along, ToCenterX);
+		const VectorRegister4Float OffsetY = VectorNegateMultiplyAdd(DirectionY, Along, ToCenterY);
+		const VectorRegister4Float OffsetZ = VectorNegateMultiplyAdd(DirectionZ, Along, ToCenterZ);
+		const VectorRegister4Float DistSq = VectorMultiplyAdd(OffsetZ, OffsetZ, VectorMultiplyAdd(OffsetY, OffsetY, VectorMultiply(OffsetX, OffsetX)));
+
+		const VectorRegister4Float Radius = VectorLoad(&CandidateRadius[Index]);
+		const int32 Mask = VectorMaskBits(VectorCompareLE(DistSq, VectorMultiply(Radius, Radius)));
+		if (Mask == 0) continue;
+
+		for (int32 Lane = 0; Lane < 4 && Index + Lane < NumCandidates; Lane++)
+		{
+			if (Mask & (1 << Lane))
+			{
+				TraceHistory(Histories[CandidateHistories[Index + Lane]], Time, Origin, Direction, Distance, OutHit);
+			}
+		}
+	}
+
+	return OutHit.IsHit();
+}
+
+void UCMPLagCompensationSubsystem::TraceHistory(const FCMPHitboxHistory& History, double Time, const FVector& Origin,
+                                                const FVector& Direction, float Distance, FCMPRewindHit& OutHit)
+{
+	int32 FromSlot, ToSlot;
+	float Alpha;
+	if (!History.FindFrames(Time, FromSlot, ToSlot, Alpha)) return;
+
+	// The movement capsule is larger than the bones and would win most hits, it only counts without a bone pose
+	const bool bTestMovementCapsule = !History.bBonesPosed[FromSlot] || !History.bBonesPosed[ToSlot];
+
+	const int32 NumPadded = History.NumPadded;
+	const int32 FromBase = FromSlot * NumPadded;
+	const int32 ToBase = ToSlot * NumPadded;
+	const VectorRegister4Float VectorAlpha = VectorSetFloat1(Alpha);
+
+	auto Rewind = [NumPadded, FromBase, ToBase, &VectorAlpha](const TArray<float>& Column, TArray<float>& OutColumn)
+	{
+		OutColumn.SetNumUninitialized(NumPadded, EAllowShrinking::No);
+		for (int32 Index = 0; Index < NumPadded; Index += 4)
+		{
+			const VectorRegister4Float From = VectorLoad(&Column[FromBase + Index]);
+			const VectorRegister4Float To = VectorLoad(&Column[ToBase + Index]);
+			VectorStore(VectorMultiplyAdd(VectorSubtract(To, From), VectorAlpha, From), &OutColumn[Index]);
+		}
+	};
+
+	Rewind(History.StartX, RewoundStartX);
+	Rewind(History.StartY, RewoundStartY);
+	Rewind(History.StartZ, RewoundStartZ);
+	Rewind(History.EndX, RewoundEndX);
+	Rewind(History.EndY, RewoundEndY);
+	Rewind(History.EndZ, RewoundEndZ);
+
+	// Closest points between the ray segment and each capsule segment, after Real-Time Collision Detection 5.1.9
+	const FVector3f Ray = FVector3f(Direction * Distance);
+	const VectorRegister4Float OriginX = VectorSetFloat1(float(Origin.X));
+	const VectorRegister4Float OriginY = VectorSetFloat1(float(Origin.Y));
+	const VectorRegister4Float OriginZ = VectorSetFloat1(float(Origin.Z));
+	const VectorRegister4Float RayX = VectorSetFloat1(Ray.X);
+	const VectorRegister4Float RayY = VectorSetFloat1(Ray.Y);
+	const VectorRegister4Float RayZ = VectorSetFloat1(Ray.Z);
+	const VectorRegister4Float InvRayLengthSq = VectorSetFloat1(1.f / FMath::Square(Distance));
+	const VectorRegister4Float RayLengthSq = VectorSetFloat1(FMath::Square(Distance));
+	const VectorRegister4Float Zero = VectorZeroFloat();
+	const VectorRegister4Float One = VectorOneFloat();
+	const VectorRegister4Float Epsilon = VectorSetFloat1(UE_KINDA_SMALL_NUMBER);
+
+	auto Clamp01 = [&Zero, &One](const VectorRegister4Float& Value)
+	{
+		return VectorMin(VectorMax(Value, Zero), One);
+	};
+
+	for (int32 Index = 0; Index < NumPadded; Index += 4)
+	{
+		const VectorRegister4Float StartX = VectorLoad(&RewoundStartX[Index]);
+		const VectorRegister4Float StartY = VectorLoad(&RewoundStartY[Index]);
+		const VectorRegister4Float StartZ = VectorLoad(&RewoundStartZ[Index]);
+		const VectorRegister4Float SegmentX = VectorSubtract(VectorLoad(&RewoundEndX[Index]), StartX);
+		const VectorRegister4Float SegmentY = VectorSubtract(VectorLoad(&RewoundEndY[Index]), StartY);
+		const VectorRegister4Float SegmentZ = VectorSubtract(VectorLoad(&RewoundEndZ[Index]), StartZ);
+		const VectorRegister4Float FromStartX = VectorSubtract(OriginX, StartX);
+		const VectorRegister4Float FromStartY = VectorSubtract(OriginY, StartY);
+		const VectorRegister4Float FromStartZ = VectorSubtract(OriginZ, StartZ);
+
+		auto Dot = [](const VectorRegister4Float& AX, const VectorRegister4Float& AY, const VectorRegister4Float& AZ,
+		              const VectorRegister4Float& BX, const VectorRegister4Float& BY, const VectorRegister4Float& BZ)
+		{
+			return VectorMultiplyAdd(AZ, BZ, VectorMultiplyAdd(AY, BY, VectorMultiply(AX, BX)));
+		};
+
+		// Spheres have no segment, the epsilon keeps their division finite
+		const VectorRegister4Float SegmentLengthSq = VectorMax(Dot(SegmentX, SegmentY, SegmentZ, SegmentX, SegmentY, SegmentZ), Epsilon);
+		const VectorRegister4Float RayDotSegment = Dot(RayX, RayY, RayZ, SegmentX, SegmentY, SegmentZ);
+		const VectorRegister4Float RayDotFromStart = Dot(RayX, RayY, RayZ, FromStartX, FromStartY, FromStartZ);
+		const VectorRegister4Float SegmentDotFromStart = Dot(SegmentX, SegmentY, SegmentZ, FromStartX, FromStartY, FromStartZ);
+
+		// Fraction along the ray for the unclamped closest points, the start of the ray for parallel segments
+		const VectorRegister4Float Denominator = VectorNegateMultiplyAdd(RayDotSegment, RayDotSegment, VectorMultiply(RayLengthSq, SegmentLengthSq));
+		const VectorRegister4Float Numerator = VectorNegateMultiplyAdd(RayDotFromStart, SegmentLengthSq, VectorMultiply(RayDotSegment, SegmentDotFromStart));
+		VectorRegister4Float RayFraction = VectorSelect(VectorCompareGT(Denominator, Epsilon),
+		                                                Clamp01(VectorDivide(Numerator, VectorMax(Denominator, Epsilon))), Zero);
+
+		// Fraction along the capsule segment, past either end it is clamped and the ray fraction recomputed
+		const VectorRegister4Float SegmentFraction = VectorDivide(VectorMultiplyAdd(RayDotSegment, RayFraction, SegmentDotFromStart), SegmentLengthSq);
+		const VectorRegister4Float RayFractionAtStart = Clamp01(VectorMultiply(VectorNegate(RayDotFromStart), InvRayLengthSq));
+		const VectorRegister4Float RayFractionAtEnd = Clamp01(VectorMultiply(VectorSubtract(RayDotSegment, RayDotFromStart), InvRayLengthSq));
+		RayFraction = VectorSelect(VectorCompareLT(SegmentFraction, Zero), RayFractionAtStart,
+		                           VectorSelect(VectorCompareGT(SegmentFraction, One), RayFractionAtEnd, RayFraction));
+		const VectorRegister4Float ClampedSegmentFraction = Clamp01(SegmentFraction);
+
+		const VectorRegister4Float OffsetX = VectorSubtract(VectorMultiplyAdd(RayX, RayFraction, FromStartX), VectorMultiply(SegmentX, ClampedSegmentFraction));
+		const VectorRegister4Float OffsetY = VectorSubtract(VectorMultiplyAdd(RayY, RayFraction, FromStartY), VectorMultiply(SegmentY, ClampedSegmentFraction));
+		const VectorRegister4Float OffsetZ = VectorSubtract(VectorMultiplyAdd(RayZ, RayFraction, FromStartZ), VectorMultiply(SegmentZ, ClampedSegmentFraction));
+		const VectorRegister4Float DistSq = Dot(OffsetX, OffsetY, OffsetZ, OffsetX, OffsetY, OffsetZ);
+
+		const VectorRegister4Float Radius = VectorLoad(&History.Radii[Index]);
+		int32 Mask = VectorMaskBits(VectorCompareLE(DistSq, VectorMultiply(Radius, Radius)));
+		if (Index == 0 && !bTestMovementCapsule)
+		{
+			Mask &= ~1;
+		}
+		if (Mask == 0) continue;
+
+		float LaneDistSq[4];
+		float LaneRayFraction[4];
+		VectorStore(DistSq, LaneDistSq);
+		VectorStore(RayFraction, LaneRayFraction);
+
+		for (int32 Lane = 0; Lane < 4 && Index + Lane < History.NumHitboxes; Lane++)
+		{
+			if (!(Mask & (1 << Lane))) continue;
+
+			// Back from the closest approach to where the ray enters the capsule
+			const float RadiusSq = FMath::Square(History.Radii[Index + Lane]);
+			const float HitDistance = FMath::Max(
+				LaneRayFraction[Lane] * Distance - FMath::Sqrt(FMath::Max(RadiusSq - LaneDistSq[Lane], 0.f)), 0.f);
+
+			if (!OutHit.IsHit() || HitDistance < OutHit.Distance)
+			{
+				OutHit.Character = History.Character;
+				OutHit.HitboxIndex = Index + Lane;
+				OutHit.Distance = HitDistance;
+			}
+		}
+	}
+}
@@ -0,0 +1,349 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "System/CMPMovementBenchmark.h"
+
+#include "Dom/JsonObject.h"
+#include "EngineUtils.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerStart.h"
+#include "Misc/App.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Player/CMPCharacter.h"
+#include "Player/CMPCharacterMovementComponent.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+
+DEFINE_LOG_CATEGORY_STATIC(LogCryMPBenchmark, Log, All);
+
+namespace
+{
+	constexpr float SpawnSpacing = 300.f;
+
+	void StartMovementBenchmark(const TArray<FString>& Args, UWorld* World)
+	{
+#if !UE_BUILD_SHIPPING
+		if (!World || World->GetNetMode() == NM_Client)
+		{
+			UE_LOG(LogCryMPBenchmark, Warning, TEXT("CryMP.Benchmark.Movement needs a server or standalone world."));
+			return;
+		}
+
+		const FString Params = FString::Join(Args, TEXT(" "));
+
+		int32 Count = 256;
+		float Warmup = 2.f;
+		float Duration = 30.f;
+		FParse::Value(*Params, TEXT("Count="), Count);
+		FParse::Value(*Params, TEXT("Warmup="), Warmup);
+		FParse::Value(*Params, TEXT("Duration="), Duration);
+		const bool bQuit = Args.Contains(TEXT("Quit"));
+
+		// The default pawn carries the gait settings, the native class has none
+		TSubclassOf<ACMPCharacter> CharacterClass;
+		FString ClassPath;
+		if (FParse::Value(*Params, TEXT("Class="), ClassPath))
+		{
+			CharacterClass = LoadClass<ACMPCharacter>(nullptr, *ClassPath);
+		}
+		else if (const AGameModeBase* GameMode = World->GetAuthGameMode())
+		{
+			CharacterClass = GameMode->DefaultPawnClass.Get();
+		}
+
+		if (!CharacterClass)
+		{
+			UE_LOG(LogCryMPBenchmark, Warning, TEXT("No CMP character class, pass Class=/Game/Path/BP_Character.BP_Character_C"));
+			return;
+		}
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.bDeferConstruction = true;
+		ACMPMovementBenchmark* Benchmark = World->SpawnActor<ACMPMovementBenchmark>(SpawnParams);
+		Benchmark->Configure(CharacterClass, FMath::Max(Count, 1), FMath::Max(Warmup, 0.f), FMath::Max(Duration, 1.f), bQuit);
+		Benchmark->FinishSpawning(FTransform::Identity);
+#endif
+	}
+
+	FAutoConsoleCommandWithWorldAndArgs StartMovementBenchmarkCommand(
+		TEXT("CryMP.Benchmark.Movement"),
+		TEXT("Spawns scripted CMP characters and writes movement timings to Saved/Benchmarks. Args: Count=256 Warmup=2 Duration=30 Class=<path> Quit"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StartMovementBenchmark));
+
+	TSharedRef<FJsonObject> MakeTimingJson(uint64 Cycles, uint32 Calls, int32 NumCharacters, int32 NumFrames)
+	{
+		const double TotalMs = FPlatformTime::ToMilliseconds64(Cycles);
+
+		TSharedRef<FJsonObject> Json = MakeShared<FJsonObject>();
+		Json->SetNumberField(TEXT("calls"), Calls);
+		Json->SetNumberField(TEXT("totalMs"), TotalMs);
+		Json->SetNumberField(TEXT("avgUsPerCall"), Calls > 0 ? TotalMs * 1000.0 / Calls : 0.0);
+		Json->SetNumberField(TEXT("avgUsPerCharacterFrame"),
+		                     NumCharacters > 0 && NumFrames > 0 ? TotalMs * 1000.0 / (NumCharacters * NumFrames) : 0.0);
+		return Json;
+	}
+
+	float GetPercentile(const TArray<float>& Sorted, float Percentile)
+	{
+		if (Sorted.IsEmpty()) return 0.f;
+		return Sorted[FMath::Clamp(FMath::FloorToInt(Percentile * (Sorted.Num() - 1)), 0, Sorted.Num() - 1)];
+	}
+}
+
+ACMPMovementBenchmark::ACMPMovementBenchmark()
+{
+	// Input for a frame has to be in before the movement components tick
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+	bReplicates = false;
+}
+
+void ACMPMovementBenchmark::Configure(TSubclassOf<ACMPCharacter> InCharacterClass, int32 InCount, float InWarmup,
+                                      float InDuration, bool bInQuitWhenDone)
+{
+	CharacterClass = InCharacterClass;
+	Count = InCount;
+	Warmup = InWarmup;
+	Duration = InDuration;
+	bQuitWhenDone = bInQuitWhenDone;
+}
+
+void ACMPMovementBenchmark::BeginPlay()
+{
+	Super::BeginPlay();
+
+	SpawnCharacters();
+	StartTime = GetWorld()->GetTimeSeconds();
+
+	UE_LOG(LogCryMPBenchmark, Display, TEXT("Movement benchmark: %d x %s, %.0fs warmup, %.0fs measured"),
+	       Characters.Num(), *GetNameSafe(CharacterClass), Warmup, Duration);
+}
+
+void ACMPMovementBenchmark::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+#if !UE_BUILD_SHIPPING
+	if (FCMPMovementTimings::Active == &Timings)
+	{
+		FCMPMovementTimings::Active = nullptr;
+	}
+#endif
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ACMPMovementBenchmark::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	const float Time = GetWorld()->GetTimeSeconds() - StartTime;
+	DriveCharacters(Time);
+
+	if (!bMeasuring)
+	{
+		if (Time >= Warmup)
+		{
+			StartMeasuring();
+		}
+		return;
+	}
+
+	// Game thread time excludes the wait for the server tick rate
+	FrameTimes.Add(FPlatformTime::ToMilliseconds(GGameThreadTime));
+
+	if (Time >= Warmup + Duration)
+	{
+		FinishMeasuring();
+	}
+}
+
+void ACMPMovementBenchmark::SpawnCharacters()
+{
+	FVector Origin = FVector::ZeroVector;
+	if (TActorIterator<APlayerStart> It(GetWorld()); It)
+	{
+		Origin = It->GetActorLocation();
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	const int32 Side = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(Count)));
+	const FVector GridOffset(-0.5f * (Side - 1) * SpawnSpacing, -0.5f * (Side - 1) * SpawnSpacing, 0.f);
+
+	Characters.Reserve(Count);
+	Scripts.Reserve(Count);
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		const FVector Location = Origin + GridOffset + FVector(Index % Side, Index / Side, 0.f) * SpawnSpacing;
+		ACMPCharacter* Character = GetWorld()->SpawnActor<ACMPCharacter>(CharacterClass, Location, FRotator::ZeroRotator, SpawnParams);
+		if (!Character) continue;
+
+		// Simulate without a controller, input comes from DriveCharacters before the movement ticks
+		Character->GetCharacterMovement()->bRunPhysicsWithNoController = true;
+		Character->GetCharacterMovement()->PrimaryComponentTick.AddPrerequisite(this, PrimaryActorTick);
+
+		Characters.Add(Character);
+
+		// Fixed seeds so every run plays the same input
+		FAgentScript& Script = Scripts.AddDefaulted_GetRef();
+		Script.Random.Initialize(Index);
+	}
+}
+
+void ACMPMovementBenchmark::DriveCharacters(float Time)
+{
+	for (int32 Index = 0; Index < Characters.Num(); Index++)
+	{
+		ACMPCharacter* Character = Characters[Index];
+		if (!IsValid(Character)) continue;
+
+		FAgentScript& Script = Scripts[Index];
+		const auto Movement = Cast<UCMPCharacterMovementComponent>(Character->GetCharacterMovement());
+
+		if (Time >= Script.NextDirectionTime)
+		{
+			Script.Direction = FRotator(0.f, Script.Random.FRandRange(-180.f, 180.f), 0.f).Vector();
+			Script.NextDirectionTime = Time + Script.Random.FRandRange(1.f, 3.f);
+
+			// Characters look where they go, so jog is allowed most of the time
+			Character->SetActorRotation(Script.Direction.Rotation());
+		}
+
+		if (Movement && Time >= Script.NextGaitTime)
+		{
+			Script.bJogging = !Script.bJogging;
+			if (Script.bJogging)
+			{
+				Movement->StartJog();
+			}
+			else
+			{
+				Movement->StopJog();
+			}
+			Script.NextGaitTime = Time + Script.Random.FRandRange(2.f, 5.f);
+		}
+
+		if (Movement && Time >= Script.NextCrouchTime)
+		{
+			Movement->ToggleCrouch();
+			Script.NextCrouchTime = Time + Script.Random.FRandRange(4.f, 8.f);
+		}
+
+		if (Time >= Script.NextJumpTime)
+		{
+			Character->Jump();
+			Script.NextJumpTime = Time + Script.Random.FRandRange(3.f, 6.f);
+		}
+		else
+		{
+			Character->StopJumping();
+		}
+
+		Character->AddMovementInput(Script.Direction);
+	}
+}
+
+void ACMPMovementBenchmark::StartMeasuring()
+{
+	bMeasuring = true;
+	FrameTimes.Reset();
+
+	StartUsedPhysical = FPlatformMemory::GetStats().UsedPhysical;
+	StartObjectCount = GUObjectArray.GetObjectArrayNumMinusAvailable();
+
+#if !UE_BUILD_SHIPPING
+	Timings = FCMPMovementTimings();
+	FCMPMovementTimings::Active = &Timings;
+#endif
+}
+
+void ACMPMovementBenchmark::FinishMeasuring()
+{
+#if !UE_BUILD_SHIPPING
+	FCMPMovementTimings::Active = nullptr;
+#endif
+	bMeasuring = false;
+
+	WriteResults();
+
+	for (ACMPCharacter* Character : Characters)
+	{
+		if (IsValid(Character))
+		{
+			Character->Destroy();
+		}
+	}
+	Characters.Reset();
+	Scripts.Reset();
+
+	if (bQuitWhenDone)
+	{
+		FPlatformMisc::RequestExit(false, TEXT("ACMPMovementBenchmark"));
+	}
+
+	Destroy();
+}
+
+void ACMPMovementBenchmark::WriteResults() const
+{
+#if !UE_BUILD_SHIPPING
+	const int32 NumFrames = FrameTimes.Num();
+	const int32 NumCharacters = Characters.Num();
+
+	TArray<float> SortedFrameTimes = FrameTimes;
+	SortedFrameTimes.Sort();
+
+	double TotalFrameMs = 0.0;
+	for (const float FrameTime : FrameTimes)
+	{
+		TotalFrameMs += FrameTime;
+	}
+
+	TSharedRef<FJsonObject> FrameJson = MakeShared<FJsonObject>();
+	FrameJson->SetNumberField(TEXT("count"), NumFrames);
+	FrameJson->SetNumberField(TEXT("avgMs"), NumFrames > 0 ? TotalFrameMs / NumFrames : 0.0);
+	FrameJson->SetNumberField(TEXT("p50Ms"), GetPercentile(SortedFrameTimes, 0.5f));
+	FrameJson->SetNumberField(TEXT("p95Ms"), GetPercentile(SortedFrameTimes, 0.95f));
+	FrameJson->SetNumberField(TEXT("maxMs"), SortedFrameTimes.IsEmpty() ? 0.f : SortedFrameTimes.Last());
+
+	// Allocation counts need a malloc profiler, growth of used memory and live objects is what we can read here
+	const int64 UsedPhysicalDelta = static_cast<int64>(FPlatformMemory::GetStats().UsedPhysical) - static_cast<int64>(StartUsedPhysical);
+	const int32 ObjectDelta = GUObjectArray.GetObjectArrayNumMinusAvailable() - StartObjectCount;
+
+	TSharedRef<FJsonObject> MemoryJson = MakeShared<FJsonObject>();
+	MemoryJson->SetNumberField(TEXT("usedPhysicalDeltaKB"), UsedPhysicalDelta / 1024.0);
+	MemoryJson->SetNumberField(TEXT("usedPhysicalDeltaPerFrameBytes"), NumFrames > 0 ? static_cast<double>(UsedPhysicalDelta) / NumFrames : 0.0);
+	MemoryJson->SetNumberField(TEXT("uobjectDelta"), ObjectDelta);
+
+	TSharedRef<FJsonObject> Json = MakeShared<FJsonObject>();
+	Json->SetStringField(TEXT("timestamp"), FDateTime::UtcNow().ToIso8601());
+	Json->SetStringField(TEXT("map"), GetWorld()->GetMapName());
+	Json->SetStringField(TEXT("buildConfiguration"), LexToString(FApp::GetBuildConfiguration()));
+	Json->SetStringField(TEXT("characterClass"), GetPathNameSafe(CharacterClass));
+	Json->SetNumberField(TEXT("characters"), NumCharacters);
+	Json->SetNumberField(TEXT("warmupSeconds"), Warmup);
+	Json->SetNumberField(TEXT("durationSeconds"), Duration);
+	Json->SetObjectField(TEXT("gameThreadFrame"), FrameJson);
+	Json->SetObjectField(TEXT("performMovement"), MakeTimingJson(Timings.PerformMovementCycles, Timings.PerformMovementCalls, NumCharacters, NumFrames));
+	Json->SetObjectField(TEXT("onMovementUpdated"), MakeTimingJson(Timings.MovementUpdatedCycles, Timings.MovementUpdatedCalls, NumCharacters, NumFrames));
+	Json->SetObjectField(TEXT("memory"), MemoryJson);
+
+	FString Output;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Output);
+	FJsonSerializer::Serialize(Json, Writer);
+
+	const FString FileName = FPaths::ProjectSavedDir() / TEXT("Benchmarks") /
+		FString::Printf(TEXT("MovementBenchmark-%s.json"), *FDateTime::Now().ToString());
+	if (FFileHelper::SaveStringToFile(Output, *FileName))
+	{
+		UE_LOG(LogCryMPBenchmark, Display, TEXT("Movement benchmark results written to %s"), *FileName);
+	}
+	else
+	{
+		UE_LOG(LogCryMPBenchmark, Error, TEXT("Could not write movement benchmark results to %s"), *FileName);
+	}
+#endif
+}
@@ -0,0 +1,169 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "System/CMPMovementValidationSubsystem.h"
+
+#include "Player/CMPCharacter.h"
+#include "Player/CMPCharacterMovementComponent.h"
+
+
+DEFINE_LOG_CATEGORY_STATIC(LogCryMPMovementValidation, Log, All);
+
+namespace CryMP::MovementValidation
+{
+	int32 Enable = 1;
+	static FAutoConsoleVariableRef CVarCryMPMovementValidationEnable(TEXT("CryMP.MovementValidation.Enable"), Enable, TEXT("Validate every client move processed by the server."), ECVF_Default);
+
+	float SpeedTolerance = 1.25f;
+	static FAutoConsoleVariableRef CVarCryMPMovementValidationSpeedTolerance(TEXT("CryMP.MovementValidation.SpeedTolerance"), SpeedTolerance, TEXT("Multiplier on the gait max speed and rise speed a move may reach."), ECVF_Default);
+
+	float DistanceSlack = 5.f;
+	static FAutoConsoleVariableRef CVarCryMPMovementValidationDistanceSlack(TEXT("CryMP.MovementValidation.DistanceSlack"), DistanceSlack, TEXT("Distance in cm every move may exceed its speed limit by, covers depenetration and quantization."), ECVF_Default);
+
+	float TeleportDistance = 500.f;
+	static FAutoConsoleVariableRef CVarCryMPMovementValidationTeleportDistance(TEXT("CryMP.MovementValidation.TeleportDistance"), TeleportDistance, TEXT("Distance in cm a single move may never exceed."), ECVF_Default);
+}
+
+namespace
+{
+	// Rise speed for modes the fly check does not apply to, small enough to stay finite after scaling
+	constexpr float UnlimitedRiseSpeed = 1.e7f;
+}
+
+void UCMPMovementValidationSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (Characters.IsEmpty()) return;
+
+	ValidateMoves();
+	ReportViolations();
+	ResetMoves();
+}
+
+TStatId UCMPMovementValidationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCMPMovementValidationSubsystem, STATGROUP_Tickables);
+}
+
+bool UCMPMovementValidationSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UCMPMovementValidationSubsystem::AddMove(ACMPCharacter* Character, const FVector& Delta, float DeltaTime,
+                                              float MaxSpeed, const UCMPCharacterMovementComponent& Movement)
+{
+	if (!CryMP::MovementValidation::Enable || DeltaTime <= 0.f) return;
+
+	float MaxRiseSpeed;
+	switch (Movement.MovementMode)
+	{
+	case MOVE_Walking:
+	case MOVE_NavWalking:
+		// Slopes up to the walkable angle, steps are covered by the slack
+		MaxRiseSpeed = MaxSpeed;
+		break;
+	case MOVE_Falling:
+		MaxRiseSpeed = Movement.JumpZVelocity;
+		break;
+	default:
+		MaxRiseSpeed = UnlimitedRiseSpeed;
+		break;
+	}
+
+	DeltaX.Add(Delta.X);
+	DeltaY.Add(Delta.Y);
+	DeltaZ.Add(Delta.Z);
+	DeltaTimes.Add(DeltaTime);
+	MaxSpeeds.Add(MaxSpeed);
+	MaxRiseSpeeds.Add(MaxRiseSpeed);
+	RiseSlacks.Add(Movement.MaxStepHeight);
+
+	Characters.Add(Character);
+	Gaits.Add(static_cast<uint8>(Movement.GetCurrentGait()));
+	MovementModes.Add(Movement.MovementMode);
+}
+
+void UCMPMovementValidationSubsystem::ValidateMoves()
+{
+	const int32 NumMoves = Characters.Num();
+	const int32 NumPadded = Align(NumMoves, 4);
+
+	// Zeroed moves never fail a check
+	for (TArray<float>* Column : {&DeltaX, &DeltaY, &DeltaZ, &DeltaTimes, &MaxSpeeds, &MaxRiseSpeeds, &RiseSlacks})
+	{
+		Column->SetNumZeroed(NumPadded, EAllowShrinking::No);
+	}
+
+	const VectorRegister4Float Tolerance = VectorSetFloat1(CryMP::MovementValidation::SpeedTolerance);
+	const VectorRegister4Float Slack = VectorSetFloat1(CryMP::MovementValidation::DistanceSlack);
+	const VectorRegister4Float TeleportDistSq = VectorSetFloat1(FMath::Square(CryMP::MovementValidation::TeleportDistance));
+
+	for (int32 Index = 0; Index < NumPadded; Index += 4)
+	{
+		const VectorRegister4Float X = VectorLoad(&DeltaX[Index]);
+		const VectorRegister4Float Y = VectorLoad(&DeltaY[Index]);
+		const VectorRegister4Float Z = VectorLoad(&DeltaZ[Index]);
+		const VectorRegister4Float Time = VectorLoad(&DeltaTimes[Index]);
+
+		const VectorRegister4Float Dist2DSq = VectorMultiplyAdd(Y, Y, VectorMultiply(X, X));
+		const VectorRegister4Float MaxDist = VectorMultiplyAdd(VectorMultiply(VectorLoad(&MaxSpeeds[Index]), Tolerance), Time, Slack);
+		const int32 SpeedMask = VectorMaskBits(VectorCompareGT(Dist2DSq, VectorMultiply(MaxDist, MaxDist)));
+
+		const int32 TeleportMask = VectorMaskBits(VectorCompareGT(VectorMultiplyAdd(Z, Z, Dist2DSq), TeleportDistSq));
+
+		const VectorRegister4Float MaxRise = VectorMultiplyAdd(VectorMultiply(VectorLoad(&MaxRiseSpeeds[Index]), Tolerance),
+		                                                       Time, VectorAdd(VectorLoad(&RiseSlacks[Index]), Slack));
+		const int32 FlyMask = VectorMaskBits(VectorCompareGT(Z, MaxRise));
+
+		if ((SpeedMask | TeleportMask | FlyMask) == 0) continue;
+
+		for (int32 Lane = 0; Lane < 4 && Index + Lane < NumMoves; Lane++)
+		{
+			const int32 LaneBit = 1 << Lane;
+
+			ECMPMovementViolation Violations = ECMPMovementViolation::None;
+			if (SpeedMask & LaneBit) Violations |= ECMPMovementViolation::Speed;
+			if (TeleportMask & LaneBit) Violations |= ECMPMovementViolation::Teleport;
+			if (FlyMask & LaneBit) Violations |= ECMPMovementViolation::Fly;
+
+			if (Violations == ECMPMovementViolation::None) continue;
+
+			const int32 MoveIndex = Index + Lane;
+			FrameViolations.FindOrAdd(Characters[MoveIndex]) |= Violations;
+
+			UE_LOG(LogCryMPMovementValidation, Verbose,
+			       TEXT("%s failed move validation (0x%x): delta %s in %.3fs, gait %d, mode %d"),
+			       *GetNameSafe(Characters[MoveIndex]), static_cast<uint8>(Violations),
+			       *FVector(DeltaX[MoveIndex], DeltaY[MoveIndex], DeltaZ[MoveIndex]).ToString(),
+			       DeltaTimes[MoveIndex], Gaits[MoveIndex], MovementModes[MoveIndex]);
+		}
+	}
+}
+
+void UCMPMovementValidationSubsystem::ReportViolations()
+{
+	for (const TPair<ACMPCharacter*, ECMPMovementViolation>& Violation : FrameViolations)
+	{
+		if (!IsValid(Violation.Key)) continue;
+
+		UE_LOG(LogCryMPMovementValidation, Log, TEXT("%s failed move validation (0x%x)"), *Violation.Key->GetName(),
+		       static_cast<uint8>(Violation.Value));
+
+		OnMovementViolation.Broadcast(Violation.Key, Violation.Value);
+	}
+}
+
+void UCMPMovementValidationSubsystem::ResetMoves()
+{
+	for (TArray<float>* Column : {&DeltaX, &DeltaY, &DeltaZ, &DeltaTimes, &MaxSpeeds, &MaxRiseSpeeds, &RiseSlacks})
+	{
+		Column->Reset();
+	}
+
+	Characters.Reset();
+	Gaits.Reset();
+	MovementModes.Reset();
+	FrameViolations.Reset();
+}
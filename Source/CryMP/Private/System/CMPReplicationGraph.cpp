@@ -19,6 +19,7 @@
 #include "CMPCharacter.h"
 #include "CMPPlayerController.h"
 #include "System/CMPReplicationGraphSettings.h"
+#include "System/CMPRepGraphRoutingInterface.h"
 
 DEFINE_LOG_CATEGORY(LogCryMPRepGraph);
 
@@ -61,6 +62,21 @@ namespace CryMP::RepGraph
 	int32 EnableFastSharedPath = 1;
 	static FAutoConsoleVariableRef CVarCryMPRepEnableFastSharedPath(TEXT("CryMP.RepGraph.EnableFastSharedPath"), EnableFastSharedPath, TEXT(""), ECVF_Default);
 
+	// Characters farther than this from a connection's viewer send it movement at whole centimetre precision.
+	float MovementWholeNumberQuantizationDist = 5000.f;
+	static FAutoConsoleVariableRef CVarCryMPRepMovementWholeNumberQuantizationDist(TEXT("CryMP.RepGraph.MovementWholeNumberQuantizationDist"), MovementWholeNumberQuantizationDist, TEXT("Distance beyond which character movement is sent at whole centimetre precision. 0 disables."), ECVF_Default);
+
+	// Characters farther than this from a connection's viewer send it movement at decimetre precision.
+	float MovementDecimetreQuantizationDist = 15000.f;
+	static FAutoConsoleVariableRef CVarCryMPRepMovementDecimetreQuantizationDist(TEXT("CryMP.RepGraph.MovementDecimetreQuantizationDist"), MovementDecimetreQuantizationDist, TEXT("Distance beyond which character movement is sent at decimetre precision. 0 disables."), ECVF_Default);
+
+	// Characters without movement, view or weapon activity for this long drop to IdleNetUpdateFrequency and skip the FastShared path.
+	float NetIdleDelay = 2.f;
+	static FAutoConsoleVariableRef CVarCryMPRepNetIdleDelay(TEXT("CryMP.RepGraph.NetIdleDelay"), NetIdleDelay, TEXT("Seconds without activity before a character is replicated at the idle rate. 0 disables."), ECVF_Default);
+
+	float IdleNetUpdateFrequency = 2.f;
+	static FAutoConsoleVariableRef CVarCryMPRepIdleNetUpdateFrequency(TEXT("CryMP.RepGraph.IdleNetUpdateFrequency"), IdleNetUpdateFrequency, TEXT("Replication frequency of idle characters."), ECVF_Default);
+
 	UReplicationDriver* ConditionalCreateReplicationDriver(UNetDriver* ForNetDriver, UWorld* World)
 	{
 		// Only create for GameNetDriver
@@ -96,6 +112,8 @@ void UCMPReplicationGraph::ResetGameWorldState()
 	Super::ResetGameWorldState();
 	
 	AlwaysRelevantStreamingLevelActors.Empty();
+	ActorRepNodePolicies.Empty();
+	NetIdleCharacters.Empty();
 
 	for(auto ConnManager : Connections)
 	{
@@ -244,24 +262,21 @@ void UCMPReplicationGraph::InitGlobalActorClassSettings()
 
 	SetClassInfo(ACharacter::StaticClass(), CharacterClassRepInfo);
 
-	{
-		// Sanity check our FSharedRepMovement type has the same quantization settings as the default character.
-		FRepMovement DefaultRepMovement = ACMPCharacter::StaticClass()->GetDefaultObject<ACMPCharacter>()->GetReplicatedMovement(); // Use the same quantization settings as our default replicatedmovement
-		FSharedRepMovement SharedRepMovement;
-		ensureMsgf(SharedRepMovement.RepMovement.LocationQuantizationLevel == DefaultRepMovement.LocationQuantizationLevel, TEXT("LocationQuantizationLevel mismatch. %d != %d"), (uint8)SharedRepMovement.RepMovement.LocationQuantizationLevel, (uint8)DefaultRepMovement.LocationQuantizationLevel);
-		ensureMsgf(SharedRepMovement.RepMovement.VelocityQuantizationLevel == DefaultRepMovement.VelocityQuantizationLevel, TEXT("VelocityQuantizationLevel mismatch. %d != %d"), (uint8)SharedRepMovement.RepMovement.VelocityQuantizationLevel, (uint8)DefaultRepMovement.VelocityQuantizationLevel);
-		ensureMsgf(SharedRepMovement.RepMovement.RotationQuantizationLevel == DefaultRepMovement.RotationQuantizationLevel, TEXT("RotationQuantizationLevel mismatch. %d != %d"), (uint8)SharedRepMovement.RepMovement.RotationQuantizationLevel, (uint8)DefaultRepMovement.RotationQuantizationLevel);
-	}
-
 	// ------------------------------------------------------------------------------------------------------
 	//	Setup FastShared replication for pawns. This is called up to once per frame per pawn to see if it wants
 	//	to send a FastShared update to all relevant connections.
+	//	The bunch is shared by every connection, so its precision is picked for the closest viewer. The
+	//	CMPReplicatedMovement property is serialized per connection and picks the precision of each viewer.
 	// ------------------------------------------------------------------------------------------------------
-	CharacterClassRepInfo.FastSharedReplicationFunc = [](AActor* Actor)
+	CharacterClassRepInfo.FastSharedReplicationFunc = [this](AActor* Actor)
 	{
 		bool bSuccess = false;
 		if (ACMPCharacter* Character = Cast<ACMPCharacter>(Actor))
 		{
+			// Idle characters already sent their last state, UpdateNetIdleCharacters wakes them on any change
+			if (Character->IsNetIdle()) return false;
+
+			Character->SetMovementQuantization(GetMovementQuantization(Character));
 			bSuccess = Character->UpdateSharedReplication();
 		}
 		return bSuccess;
@@ -345,7 +360,12 @@ void UCMPReplicationGraph::InitGlobalActorClassSettings()
 void UCMPReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo,
                                                        FGlobalActorReplicationInfo& GlobalInfo)
 {
-	const EClassRepNodeMapping Policy = GetClassNodeMapping(ActorInfo.Class);
+	if (ACMPCharacter* Character = Cast<ACMPCharacter>(ActorInfo.Actor))
+	{
+		NetIdleCharacters.Add({Character, GlobalInfo.Settings.ReplicationPeriodFrame, false});
+	}
+
+	const EClassRepNodeMapping Policy = GetActorNodeMapping(ActorInfo, GlobalInfo);
 	switch (Policy)
 	{
 	case EClassRepNodeMapping::NotRouted:
@@ -385,7 +405,20 @@ void UCMPReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActor
 
 void UCMPReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
 {
-	const EClassRepNodeMapping Policy = GetClassNodeMapping(ActorInfo.Class);
+	if (ActorInfo.Actor->IsA<ACMPCharacter>())
+	{
+		NetIdleCharacters.RemoveAllSwap([&ActorInfo](const FCMPNetIdleCharacter& Entry)
+		{
+			return Entry.Character == ActorInfo.Actor;
+		});
+	}
+
+	EClassRepNodeMapping Policy;
+	if (!ActorRepNodePolicies.RemoveAndCopyValue(ActorInfo.Actor, Policy))
+	{
+		Policy = GetClassNodeMapping(ActorInfo.Class);
+	}
+
 	switch (Policy)
 	{
 	case EClassRepNodeMapping::NotRouted:
@@ -499,6 +532,152 @@ EClassRepNodeMapping UCMPReplicationGraph::GetClassNodeMapping(UClass* Class) co
 	return EClassRepNodeMapping::NotRouted;
 }
 
+int32 UCMPReplicationGraph::ServerReplicateActors(float DeltaSeconds)
+{
+	ViewerLocations.Reset();
+	for (const UNetReplicationGraphConnection* ConnectionManager : Connections)
+	{
+		UNetConnection* NetConnection = ConnectionManager ? ConnectionManager->NetConnection.Get() : nullptr;
+		if (!NetConnection || !NetConnection->ViewTarget) continue;
+
+		const FNetViewer Viewer(NetConnection, DeltaSeconds);
+		ViewerLocations.Emplace(NetConnection, Viewer.ViewLocation);
+
+		for (UNetConnection* Child : NetConnection->Children)
+		{
+			if (Child && Child->ViewTarget)
+			{
+				ViewerLocations.Emplace(NetConnection, FNetViewer(Child, DeltaSeconds).ViewLocation);
+			}
+		}
+	}
+
+	UpdateNetIdleCharacters();
+
+	return Super::ServerReplicateActors(DeltaSeconds);
+}
+
+void UCMPReplicationGraph::UpdateNetIdleCharacters()
+{
+	const uint32 IdlePeriod = GetReplicationPeriodFrameForFrequency(CryMP::RepGraph::IdleNetUpdateFrequency);
+
+	for (FCMPNetIdleCharacter& Entry : NetIdleCharacters)
+	{
+		const bool bIdle = Entry.Character->UpdateNetIdle(CryMP::RepGraph::NetIdleDelay);
+		if (bIdle == Entry.bIdle) continue;
+
+		Entry.bIdle = bIdle;
+		SetActorReplicationPeriod(Entry.Character, bIdle ? IdlePeriod : Entry.ActiveReplicationPeriodFrame);
+	}
+}
+
+void UCMPReplicationGraph::SetActorReplicationPeriod(AActor* Actor, uint32 ReplicationPeriodFrame)
+{
+	// Connections copy the global period when they first see an actor, existing ones are updated in place
+	if (FGlobalActorReplicationInfo* GlobalInfo = GlobalActorReplicationInfoMap.Find(Actor))
+	{
+		GlobalInfo->Settings.ReplicationPeriodFrame = ReplicationPeriodFrame;
+	}
+
+	for (UNetReplicationGraphConnection* ConnectionManager : Connections)
+	{
+		if (FConnectionReplicationActorInfo* ConnectionInfo = ConnectionManager->ActorInfoMap.Find(Actor))
+		{
+			ConnectionInfo->ReplicationPeriodFrame = ReplicationPeriodFrame;
+		}
+	}
+}
+
+ECMPLocationQuantization UCMPReplicationGraph::GetMovementQuantization(const AActor* Actor) const
+{
+	// The owning connection predicts its own character and never reads FastShared movement for it
+	const UNetConnection* OwningConnection = Actor->GetNetConnection();
+	const FVector Location = Actor->GetActorLocation();
+
+	double ClosestDistSq = TNumericLimits<double>::Max();
+	for (const TPair<const UNetConnection*, FVector>& Viewer : ViewerLocations)
+	{
+		if (Viewer.Key == OwningConnection) continue;
+
+		ClosestDistSq = FMath::Min(ClosestDistSq, FVector::DistSquared(Viewer.Value, Location));
+	}
+
+	return GetMovementQuantizationForDistSq(ClosestDistSq);
+}
+
+bool UCMPReplicationGraph::GetMovementQuantizationForConnection(const FVector& Location, const UNetConnection* Connection,
+                                                                ECMPLocationQuantization& OutQuantization) const
+{
+	bool bHasViewer = false;
+	double ClosestDistSq = TNumericLimits<double>::Max();
+	for (const TPair<const UNetConnection*, FVector>& Viewer : ViewerLocations)
+	{
+		if (Viewer.Key != Connection) continue;
+
+		bHasViewer = true;
+		ClosestDistSq = FMath::Min(ClosestDistSq, FVector::DistSquared(Viewer.Value, Location));
+	}
+
+	if (!bHasViewer) return false;
+
+	OutQuantization = GetMovementQuantizationForDistSq(ClosestDistSq);
+	return true;
+}
+
+ECMPLocationQuantization UCMPReplicationGraph::GetMovementQuantizationForDistSq(double DistSq)
+{
+	const float DecimetreDist = CryMP::RepGraph::MovementDecimetreQuantizationDist;
+	if (DecimetreDist > 0.f && DistSq > FMath::Square(DecimetreDist))
+	{
+		return ECMPLocationQuantization::Decimetre;
+	}
+
+	const float WholeNumberDist = CryMP::RepGraph::MovementWholeNumberQuantizationDist;
+	if (WholeNumberDist > 0.f && DistSq > FMath::Square(WholeNumberDist))
+	{
+		return ECMPLocationQuantization::WholeNumber;
+	}
+
+	return ECMPLocationQuantization::TwoDecimals;
+}
+
+EClassRepNodeMapping UCMPReplicationGraph::GetActorNodeMapping(const FNewReplicatedActorInfo& ActorInfo,
+                                                               FGlobalActorReplicationInfo& GlobalInfo)
+{
+	const EClassRepNodeMapping ClassMapping = GetClassNodeMapping(ActorInfo.Class);
+
+	const ICMPRepGraphRoutingInterface* RoutingInterface = Cast<ICMPRepGraphRoutingInterface>(ActorInfo.Actor);
+	if (!RoutingInterface)
+	{
+		return ClassMapping;
+	}
+
+	EClassRepNodeMapping ActorMapping = ClassMapping;
+	if (!RoutingInterface->GetReplicationGraphNodeMapping(ActorMapping) || ActorMapping == ClassMapping)
+	{
+		return ClassMapping;
+	}
+
+	if (IsSpatialized(ActorMapping))
+	{
+		if (ActorInfo.Actor->bAlwaysRelevant)
+		{
+			UE_LOG(LogCryMPRepGraph, Warning, TEXT("Actor %s is AlwaysRelevant but asked to be routed into a spatialized node (%s)"), *GetNameSafe(ActorInfo.Actor), *StaticEnum<EClassRepNodeMapping>()->GetNameStringByValue((int64)ActorMapping));
+		}
+
+		// Class settings of non spatialized classes have no cull distance, the grid would then treat the actor as relevant at any distance.
+		if (!IsSpatialized(ClassMapping) && GlobalInfo.Settings.GetCullDistanceSquared() <= 0.f)
+		{
+			GlobalInfo.Settings.SetCullDistanceSquared(ActorInfo.Actor->NetCullDistanceSquared);
+		}
+	}
+
+	UE_LOG(LogCryMPRepGraph, Verbose, TEXT("Routing %s with actor override %s (class: %s)"), *GetNameSafe(ActorInfo.Actor), *StaticEnum<EClassRepNodeMapping>()->GetNameStringByValue((int64)ActorMapping), *StaticEnum<EClassRepNodeMapping>()->GetNameStringByValue((int64)ClassMapping));
+
+	ActorRepNodePolicies.Add(ActorInfo.Actor, ActorMapping);
+	return ActorMapping;
+}
+
 void UCMPReplicationGraph::RegisterClassReplicationInfo(UClass* ReplicatedClass)
 {
 	FClassReplicationInfo ClassInfo;
@@ -0,0 +1,126 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "System/CMPSignificanceManager.h"
+
+#include "Player/CMPCharacter.h"
+
+
+namespace CryMP::Significance
+{
+	int32 Enable = 1;
+	static FAutoConsoleVariableRef CVarCryMPSignificanceEnable(TEXT("CryMP.Significance.Enable"), Enable, TEXT("Throttle simulated proxy character ticking by significance."), ECVF_Default);
+
+	// Significance is capsule half height over distance, 0.05 is roughly 18m for a default capsule.
+	float ReducedThreshold = 0.05f;
+	static FAutoConsoleVariableRef CVarCryMPSignificanceReducedThreshold(TEXT("CryMP.Significance.ReducedThreshold"), ReducedThreshold, TEXT("Characters below this significance tick at ReducedTickInterval."), ECVF_Default);
+
+	float LowThreshold = 0.015f;
+	static FAutoConsoleVariableRef CVarCryMPSignificanceLowThreshold(TEXT("CryMP.Significance.LowThreshold"), LowThreshold, TEXT("Characters below this significance tick at LowTickInterval."), ECVF_Default);
+
+	float MinimalThreshold = 0.005f;
+	static FAutoConsoleVariableRef CVarCryMPSignificanceMinimalThreshold(TEXT("CryMP.Significance.MinimalThreshold"), MinimalThreshold, TEXT("Characters below this significance tick at MinimalTickInterval."), ECVF_Default);
+
+	// Characters that were not rendered recently count as this fraction of their projected size.
+	float NotRenderedScale = 0.25f;
+	static FAutoConsoleVariableRef CVarCryMPSignificanceNotRenderedScale(TEXT("CryMP.Significance.NotRenderedScale"), NotRenderedScale, TEXT(""), ECVF_Default);
+
+	float ReducedTickInterval = 1.f / 30.f;
+	static FAutoConsoleVariableRef CVarCryMPSignificanceReducedTickInterval(TEXT("CryMP.Significance.ReducedTickInterval"), ReducedTickInterval, TEXT(""), ECVF_Default);
+
+	float LowTickInterval = 1.f / 15.f;
+	static FAutoConsoleVariableRef CVarCryMPSignificanceLowTickInterval(TEXT("CryMP.Significance.LowTickInterval"), LowTickInterval, TEXT(""), ECVF_Default);
+
+	float MinimalTickInterval = 0.2f;
+	static FAutoConsoleVariableRef CVarCryMPSignificanceMinimalTickInterval(TEXT("CryMP.Significance.MinimalTickInterval"), MinimalTickInterval, TEXT(""), ECVF_Default);
+}
+
+const FName UCMPSignificanceManager::CharacterTag(TEXT("CMPCharacter"));
+
+UCMPSignificanceManager::UCMPSignificanceManager()
+{
+	// Only simulated proxies are throttled, the server simulates every character at full rate
+	bCreateOnServer = false;
+}
+
+UCMPSignificanceManager* UCMPSignificanceManager::Get(const UWorld* World)
+{
+	return World ? USignificanceManager::Get<UCMPSignificanceManager>(World) : nullptr;
+}
+
+void UCMPSignificanceManager::RegisterCharacter(ACMPCharacter* Character)
+{
+	RegisterObject(Character, CharacterTag, &CalculateCharacterSignificance, EPostSignificanceType::Sequential,
+	               &OnCharacterSignificanceChanged);
+}
+
+void UCMPSignificanceManager::UnregisterCharacter(ACMPCharacter* Character)
+{
+	UnregisterObject(Character);
+}
+
+float UCMPSignificanceManager::GetTickInterval(ECMPSignificanceTier Tier)
+{
+	switch (Tier)
+	{
+	case ECMPSignificanceTier::Reduced:
+		return CryMP::Significance::ReducedTickInterval;
+	case ECMPSignificanceTier::Low:
+		return CryMP::Significance::LowTickInterval;
+	case ECMPSignificanceTier::Minimal:
+		return CryMP::Significance::MinimalTickInterval;
+	default:
+		return 0.f;
+	}
+}
+
+float UCMPSignificanceManager::CalculateCharacterSignificance(FManagedObjectInfo* ObjectInfo,
+                                                              const FTransform& Viewpoint)
+{
+	const auto Character = Cast<ACMPCharacter>(ObjectInfo->GetObject());
+	if (!Character || !CryMP::Significance::Enable) return 1.f;
+
+	// Always full rate for the character we control
+	if (Character->IsLocallyControlled()) return 1.f;
+
+	float Radius, HalfHeight;
+	Character->GetSimpleCollisionCylinder(Radius, HalfHeight);
+
+	const double Distance = FVector::Dist(Viewpoint.GetLocation(), Character->GetActorLocation());
+	float Significance = HalfHeight / FMath::Max(Distance, 1.0);
+
+	if (!Character->WasRecentlyRendered(0.2f))
+	{
+		Significance *= CryMP::Significance::NotRenderedScale;
+	}
+
+	return Significance;
+}
+
+void UCMPSignificanceManager::OnCharacterSignificanceChanged(FManagedObjectInfo* ObjectInfo, float OldSignificance,
+                                                             float Significance, bool bFinal)
+{
+	const auto Character = Cast<ACMPCharacter>(ObjectInfo->GetObject());
+	if (!Character) return;
+
+	// Restore full rate when the character leaves the manager
+	if (bFinal)
+	{
+		Character->SetSignificanceTier(ECMPSignificanceTier::Full);
+		return;
+	}
+
+	const auto Tier = GetTier(Significance);
+	if (Tier != GetTier(OldSignificance))
+	{
+		Character->SetSignificanceTier(Tier);
+	}
+}
+
+ECMPSignificanceTier UCMPSignificanceManager::GetTier(float Significance)
+{
+	if (Significance < CryMP::Significance::MinimalThreshold) return ECMPSignificanceTier::Minimal;
+	if (Significance < CryMP::Significance::LowThreshold) return ECMPSignificanceTier::Low;
+	if (Significance < CryMP::Significance::ReducedThreshold) return ECMPSignificanceTier::Reduced;
+	return ECMPSignificanceTier::Full;
+}
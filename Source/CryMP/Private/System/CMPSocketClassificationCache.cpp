@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "System/CMPSocketClassificationCache.h"
+
+#include "Components/SkinnedMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Guns/AssemblableParent.h"
+
+
+void FCMPSocketClassification::Build(const UMeshComponent& MeshComponent, const FCMPSocketPrefixes& Prefixes)
+{
+	auto HasPrefix = [](const FString& SocketName, const FString& Prefix)
+	{
+		return !Prefix.IsEmpty() && SocketName.StartsWith(Prefix, ESearchCase::IgnoreCase);
+	};
+
+	for (const auto SocketName : MeshComponent.GetAllSocketNames())
+	{
+		const FString SocketString = SocketName.ToString();
+
+		if (HasPrefix(SocketString, Prefixes.OpticAimPoint))
+		{
+			OpticAimPoints.AddUnique(SocketName);
+		}
+		else if (HasPrefix(SocketString, Prefixes.FrontAimPoint))
+		{
+			FrontAimPoints.AddUnique(SocketName);
+		}
+		else if (HasPrefix(SocketString, Prefixes.RearAimPoint))
+		{
+			RearAimPoints.AddUnique(SocketName);
+		}
+
+		if (TopSocket.IsNone() && HasPrefix(SocketString, Prefixes.Top))
+		{
+			TopSocket = SocketName;
+		}
+	}
+}
+
+UCMPSocketClassificationCache* UCMPSocketClassificationCache::Get()
+{
+	return GEngine ? GEngine->GetEngineSubsystem<UCMPSocketClassificationCache>() : nullptr;
+}
+
+const FCMPSocketClassification& UCMPSocketClassificationCache::Classify(const AAssemblableParent& Part,
+                                                                       const UMeshComponent& MeshComponent,
+                                                                       FCMPSocketClassification& Scratch)
+{
+	const UObject* MeshAsset = GetMeshAsset(MeshComponent);
+	if (!MeshAsset)
+	{
+		Scratch.Build(MeshComponent, Part.GetSocketPrefixes());
+		return Scratch;
+	}
+
+	const TPair<TObjectKey<UObject>, TObjectKey<UClass>> Key(MeshAsset, Part.GetClass());
+	if (const FCMPSocketClassification* Classification = Classifications.Find(Key))
+	{
+		return *Classification;
+	}
+
+	FCMPSocketClassification& Classification = Classifications.Add(Key);
+	Classification.Build(MeshComponent, Part.GetSocketPrefixes());
+	return Classification;
+}
+
+const TArray<FName>& UCMPSocketClassificationCache::GetSortedSocketNames(const UMeshComponent& MeshComponent,
+                                                                      TArray<FName>& Scratch)
+{
+	const UObject* MeshAsset = GetMeshAsset(MeshComponent);
+	if (MeshAsset)
+	{
+		if (const TArray<FName>* SocketNames = SortedSocketNames.Find(MeshAsset))
+		{
+			return *SocketNames;
+		}
+	}
+
+	TArray<FName>& SocketNames = MeshAsset ? SortedSocketNames.Add(MeshAsset) : Scratch;
+	SocketNames = MeshComponent.GetAllSocketNames();
+	SocketNames.Sort(FNameLexicalLess());
+	return SocketNames;
+}
+
+void UCMPSocketClassificationCache::Deinitialize()
+{
+	Classifications.Reset();
+	SortedSocketNames.Reset();
+
+	Super::Deinitialize();
+}
+
+const UObject* UCMPSocketClassificationCache::GetMeshAsset(const UMeshComponent& MeshComponent)
+{
+	if (const auto StaticMeshComponent = Cast<UStaticMeshComponent>(&MeshComponent))
+	{
+		return StaticMeshComponent->GetStaticMesh();
+	}
+
+	if (const auto SkinnedMeshComponent = Cast<USkinnedMeshComponent>(&MeshComponent))
+	{
+		return SkinnedMeshComponent->GetSkinnedAsset();
+	}
+
+	return nullptr;
+}
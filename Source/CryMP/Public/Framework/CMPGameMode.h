@@ -16,5 +16,19 @@ class CRYMP_API ACMPGameMode : public AGameModeBase
 
 public:
 	ACMPGameMode();
-	
+
+	/** Takes characters from UCMPCharacterPoolSubsystem when one is available. */
+	virtual APawn* SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform) override;
+
+	/** Returns the controller's current character to the pool and restarts the player with a pooled one. */
+	UFUNCTION(BlueprintCallable, Category = "Game")
+	void RespawnPlayer(AController* Controller);
+
+protected:
+	virtual void BeginPlay() override;
+
+	/** Default pawns spawned into the pool when play begins. */
+	UPROPERTY(EditDefaultsOnly, Category = "Pool", meta = (ClampMin = "0"))
+	int32 PrewarmedCharacters = 8;
+
 };
@@ -6,6 +6,8 @@
 #include "GameFramework/Actor.h"
 #include "AssemblableParent.generated.h"
 
+struct FCMPSocketPrefixes;
+
 USTRUCT(BlueprintType)
 struct FAimPoint
 {
@@ -62,6 +64,9 @@ protected:
 public:
 	virtual void CustomAction(bool IsCustomActioned);
 
+	/** Socket prefixes of this class, classified once per mesh asset by UCMPSocketClassificationCache. */
+	virtual FCMPSocketPrefixes GetSocketPrefixes() const;
+
 public:
 	UFUNCTION()
 	void ApplyMaterial(UMaterialInterface* NewMaterial);
@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Net/Serialization/FastArraySerializer.h"
+#include "CMPGunLoadout.generated.h"
+
+
+class AGunParent;
+class AGunPartParent;
+struct FCMPGunLoadout;
+
+
+/** One part of a gun loadout. Classes and skins travel as their object ids, the socket as its index on the gun mesh. */
+USTRUCT()
+struct FCMPLoadoutPart : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	/** None once the part was detached. */
+	UPROPERTY()
+	TSubclassOf<AGunPartParent> PartClass;
+
+	/** Loadout index of the part this one is mounted on, -1 for the gun itself. */
+	UPROPERTY()
+	int8 BaseIndex = INDEX_NONE;
+
+	/** Index into the sorted socket names of the gun mesh, FCMPGunLoadout::InvalidSocketId for none. */
+	UPROPERTY()
+	uint16 SocketId = MAX_uint16;
+
+	UPROPERTY()
+	bool bActioned = false;
+
+	UPROPERTY()
+	TObjectPtr<UMaterialInterface> Skin = nullptr;
+
+	void PostReplicatedAdd(const FCMPGunLoadout& InArraySerializer);
+	void PostReplicatedChange(const FCMPGunLoadout& InArraySerializer);
+	void PreReplicatedRemove(const FCMPGunLoadout& InArraySerializer);
+};
+
+
+/**
+ * Everything clients need to assemble a gun locally. The initial parts are built in AGunParent::OnRep_Loadout, parts
+ * added later are spawned on their own. Detached parts keep their entry with no class so indices stay stable.
+ */
+USTRUCT()
+struct FCMPGunLoadout : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FCMPLoadoutPart> Parts;
+
+	UPROPERTY(NotReplicated)
+	TObjectPtr<AGunParent> Owner = nullptr;
+
+	// Set by item callbacks, consumed by AGunParent::OnRep_Loadout
+	mutable bool bNeedsRebuild = false;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		return FastArrayDeltaSerialize<FCMPLoadoutPart, FCMPGunLoadout>(Parts, DeltaParms, *this);
+	}
+
+	/** Socket id of a part attached to the gun mesh itself rather than to one of its sockets. */
+	static constexpr uint16 InvalidSocketId = MAX_uint16;
+
+	/** InvalidSocketId for None and for sockets the mesh does not have. */
+	static uint16 GetSocketId(const UMeshComponent* Mesh, FName SocketName);
+	static FName GetSocketName(const UMeshComponent* Mesh, uint16 SocketId);
+};
+
+template<>
+struct TStructOpsTypeTraits<FCMPGunLoadout> : public TStructOpsTypeTraitsBase2<FCMPGunLoadout>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
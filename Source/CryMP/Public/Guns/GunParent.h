@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "Guns/AssemblableParent.h"
+#include "Guns/CMPGunLoadout.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "GunParent.generated.h"
 
@@ -13,6 +14,8 @@ class AMagParent;
 class ACMPCharacter;
 
 struct FAutoAttachPart;
+struct FCMPGunAssembly;
+struct FCMPGunAssemblyKey;
 
 
 UENUM(BlueprintType)
@@ -67,6 +70,54 @@ struct FSightData
 	}
 };
 
+/**
+ * What a character shows of its current weapon: the sight it aims through and the fire mode, packed into one byte.
+ * Every machine derives the hand transform from the sight index and its own copy of AGunParent::Sights.
+ */
+USTRUCT()
+struct FCMPWeaponViewState
+{
+	GENERATED_BODY()
+
+	static constexpr int32 SightIndexBits = 5;
+	static constexpr int32 MaxSightIndex = (1 << SightIndexBits) - 1;
+
+	UPROPERTY()
+	uint8 SightIndex = 0;
+
+	UPROPERTY()
+	EFireModes FireMode = EFireModes::EFM_Safe;
+
+	UPROPERTY()
+	bool bInterpolateSight = false;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	bool operator==(const FCMPWeaponViewState& Other) const
+	{
+		return SightIndex == Other.SightIndex && FireMode == Other.FireMode && bInterpolateSight == Other.bInterpolateSight;
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FCMPWeaponViewState> : public TStructOpsTypeTraitsBase2<FCMPWeaponViewState>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
+};
+
+
+/** Where a part of AGunParent::CurrentParts is mounted, kept in step with attaching and detaching instead of walking the actor attachments. */
+struct FCMPGunPartNode
+{
+	int32 ParentIndex = INDEX_NONE;
+	TArray<int32, TInlineAllocator<4>> Children;
+};
+
+
 UCLASS(BlueprintType)
 class CRYMP_API AGunParent : public AAssemblableParent
 {
@@ -86,6 +137,18 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Category="Customization|Fire")
 	EFireModes CurrentFireMode;
 
+	/** Rounds per minute in every fire mode. */
+	UPROPERTY(EditDefaultsOnly, Category="Customization|Fire", meta=(ClampMin="1"))
+	float FireRate = 600.f;
+
+	/** Furthest a shot can hit, in cm. */
+	UPROPERTY(EditDefaultsOnly, Category="Customization|Fire", meta=(ClampMin="0", Units="cm"))
+	float Range = 30000.f;
+
+	/** Rounds fired per trigger pull in Burst. */
+	UPROPERTY(EditDefaultsOnly, Category="Customization|Fire", meta=(ClampMin="1"))
+	int32 BurstCount = 3;
+
 	UPROPERTY(BlueprintReadOnly, Replicated)
 	ACMPCharacter* CharacterOwner;
 
@@ -107,19 +170,32 @@ public:
 
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
 
 public:
 	void Equip();
 	void UnEquip();
 
-	void CalculateHandTransforms();
+	/** Server: the state the owning character replicates for this gun. */
+	FCMPWeaponViewState MakeViewState() const;
+	void ApplyViewState(const FCMPWeaponViewState& ViewState);
+
+	/** Server: back to the state after BeginPlay, for a character taken out of the pool. Parts stay assembled. */
+	void ResetForReuse();
+
+	/** Hand transform relative to the current sight, as if the gun was in the hand. False if the gun has no sights. */
+	bool CalculateHandTransform(FTransform& OutHandTransform);
 
 private:
 	void SetStartingFireMode();
 
-	void UpdateOpticSightsHandTransform();
-	void UpdateIronSightsHandTransform();
+	/** Transform from where the gun is now to where it sits when equipped, so it can be holstered during the calculation. */
+	FTransform GetToEquippedTransform(const ACMPCharacter& Character) const;
+
+	void UpdateOpticSightsHandTransform(const ACMPCharacter& Character, const FTransform& ToEquipped);
+	void UpdateIronSightsHandTransform(const ACMPCharacter& Character, const FTransform& ToEquipped);
 
 	static FTransform CalculateIronSightTransform(const FVector& FrontLocation, const FVector& RearLocation,
 	                                              const FRotator& RearRotation);
@@ -159,9 +235,25 @@ protected:
 	UPROPERTY(ReplicatedUsing=OnRep_CurrentParts, BlueprintReadOnly, Category="Parts")
 	TArray<AGunPartParent*> CurrentParts;
 
+	/**
+	 * Replicate the parts as Loadout instead of one actor channel each. The server and every client then spawn their
+	 * own unreplicated part actors from it, and magazine ammo goes to the owner through MagazineAmmo.
+	 */
+	UPROPERTY(EditDefaultsOnly, Category="Network")
+	bool bReplicateLoadoutAsDescriptor = false;
+
+	UPROPERTY(ReplicatedUsing=OnRep_Loadout)
+	FCMPGunLoadout Loadout;
+
+	UPROPERTY(ReplicatedUsing=OnRep_MagazineAmmo)
+	int32 MagazineAmmo = 0;
+
 	UPROPERTY(BlueprintReadOnly, Category="Sights")
 	TArray<FSightData> Sights;
 
+	/** Clients: the replicated parts changed since Sights was built. */
+	bool bSightsDirty = true;
+
 	UPROPERTY(Replicated, BlueprintReadOnly, Category="Sights")
 	AMagParent* Magazine;
 
@@ -190,9 +282,79 @@ public:
 	UFUNCTION(BlueprintPure, Category="Aiming")
 	FORCEINLINE float GetTimeFromAim() const { return TimeFromAim; }
 
+	UFUNCTION(BlueprintPure, Category="Fire")
+	FORCEINLINE EFireModes GetCurrentFireMode() const { return CurrentFireMode; }
+
+	FORCEINLINE float GetFireInterval() const { return 60.f / FMath::Max(FireRate, 1.f); }
+	FORCEINLINE int32 GetBurstCount() const { return BurstCount; }
+	FORCEINLINE float GetRange() const { return Range; }
+	FORCEINLINE float GetRecoilPerShot() const { return RecoilPerShot; }
+	FORCEINLINE float GetSpread(bool bAiming) const { return bAiming ? SpreadAiming : SpreadHip; }
+
+	/** Rounds left in the magazine as this machine knows it, 0 without one. */
+	int32 GetAmmo() const;
+
+	/** Takes one round from the magazine. The server replicates it to the owner, the owner predicts it locally. */
+	bool ConsumeAmmo();
+
+	/** Server: sets the ammo of the magazine, replicated to the owner in either part mode. */
+	void SetMagazineAmmo(int32 Ammo);
+
+	/** Server: changes the skin of a part in CurrentParts. */
+	void SetPartSkin(int32 PartIndex, UMaterialInterface* Skin);
+
+	/** Toggles the custom action of a part in CurrentParts. */
+	UFUNCTION(Server, Reliable)
+	void ServerPartAction(uint8 PartIndex);
+
+	/** Applies the actioned state and skin of one loadout entry to its local part actor. */
+	void ApplyLoadoutPart(int32 PartIndex);
+
+	/** Spawns the local part for a loadout entry added after the gun was assembled. */
+	void AddLoadoutPart(int32 PartIndex);
+
+	/**
+	 * Server: mounts a new part on the part at BaseIndex in CurrentParts, or on the gun itself for -1.
+	 * Only the new part is added to the stats and sights. Returns its index in CurrentParts.
+	 */
+	int32 AttachPart(TSubclassOf<AGunPartParent> PartClass, int32 BaseIndex, FName BaseSocket, bool bActioned = false);
+
+	/** Server: removes a part and everything mounted on it. Its slot in CurrentParts stays empty so indices hold. */
+	void DetachPart(int32 PartIndex);
+
 private:
+	/** Same indices as CurrentParts. */
+	TArray<FCMPGunPartNode> PartNodes;
+
+	/** The parts no longer match StartingParts, so the assembly cache does not apply. */
+	bool bHasRuntimeParts = false;
+
+	void LinkPart(int32 PartIndex, int32 ParentIndex);
+	void GetPartSubtree(int32 PartIndex, TArray<int32>& OutSubtree) const;
+	void OnPartAttached(int32 PartIndex);
+	void RemovePartSubtree(int32 PartIndex);
+	/** Builds the sights from scratch after a part change and keeps aiming through the same sight if it is still there. */
+	void RegenerateSights();
+	/**
+	 * Pushes a new sight list to the owning character if this gun is in its hands. On the server as a new view state,
+	 * on clients by deriving the hand transform again, as the replicated view state may not change with the parts.
+	 */
+	void RefreshOwnerViewState();
+
 	void ResetGunProperties();
 	void AddStartingParts();
+	void BuildLoadoutFromStartingParts();
+	void BuildLocalParts();
+	void DestroyLocalParts();
+	/** RelativeTransform comes from UCMPGunAssemblyCache, without it the part is placed by its top socket. */
+	AGunPartParent* SpawnPart(TSubclassOf<AGunPartParent> PartClass, FName BaseSocket, bool bActioned,
+	                          UMaterialInterface* Skin, bool bReplicated, const FTransform* RelativeTransform);
+
+	FCMPGunAssemblyKey MakeAssemblyKey() const;
+	const FCMPGunAssembly* FindCachedAssembly() const;
+	/** Stores the current assembly in UCMPGunAssemblyCache if there is none for this class and parts yet. */
+	void CacheAssembly() const;
+	bool ResolveCachedSights(const FCMPGunAssembly& Assembly);
 	void ModifyGunProperties();
 	void GenerateSights();
 	void SetMagazine();
@@ -204,6 +366,7 @@ private:
 	                           const UMeshComponent* ParentMeshComponent, const FName& BaseSocket);
 
 	void GenerateOpticSights(AAssemblableParent* Part);
+	/** Pairs the front aim points of InPart that have no iron sight yet with the first part in AllParts that has a matching rear. */
 	void GenerateIronSights(AAssemblableParent* InPart, const TArray<AAssemblableParent*>& AllParts);
 
 	static bool IronSightsCanBePaired(FName RearSocket, UMeshComponent* RearComp, FName FrontSocket,
@@ -211,11 +374,18 @@ private:
 
 	bool IsAimPointWithinMaxAngle(UMeshComponent* MeshComponent, FName SocketName) const;
 
-	void GetAllParts(TArray<AAssemblableParent*>& AllParts) const;
-	TArray<AGunPartParent*> GetAttachedPartsRecursevely();
+	/** The gun itself followed by every part, in CurrentParts order. */
+	void GetAllParts(TArray<AAssemblableParent*>& AllParts);
+	TArray<AGunPartParent*> GetAttachedPartsRecursevely() const;
 
-	void GetAttachedInternalLoop(const AAssemblableParent* Part, TArray<AGunPartParent*>& Parts) const;
+	bool HasIronSightForFront(const UMeshComponent* FrontComponent, FName FrontSocket) const;
 
 	UFUNCTION()
 	void OnRep_CurrentParts();
+
+	UFUNCTION()
+	void OnRep_Loadout();
+
+	UFUNCTION()
+	void OnRep_MagazineAmmo();
 };
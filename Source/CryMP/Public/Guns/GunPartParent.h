@@ -49,7 +49,7 @@ protected:
 	FString TopPrefix = "Top_";
 
 public:
-	void GetAttachedInternalLoop(const AAssemblableParent* Part, TArray<AGunPartParent*>& Parts) const;
+	virtual FCMPSocketPrefixes GetSocketPrefixes() const override;
 
 	void FindTopSocket(FName& SocketName, UMeshComponent*& MeshComponent) const;
 };
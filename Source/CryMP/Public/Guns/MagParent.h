@@ -15,6 +15,8 @@ class CRYMP_API AMagParent : public AGunPartParent
 public:
 	virtual void BeginPlay() override;
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	void ResetAmmo();
 	
 public:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Customization|Magazine")
@@ -5,15 +5,18 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
 #include "InputActionValue.h"
+#include "Guns/GunParent.h"
+#include "System/CMPLagCompensationSubsystem.h"
 #include "CMPCharacter.generated.h"
 
 class UCMPAnimInstance;
 class UCameraComponent;
 class UCMPCharacterMovementComponent;
+class UCMPWeaponFireComponent;
 class UInputMappingContext;
 class UInputAction;
-class AGunParent;
 class AGunPartParent;
+enum class ECMPSignificanceTier : uint8;
 
 /**
  * FCMPReplicatedAcceleration: Compressed representation of acceleration
@@ -31,36 +34,142 @@ struct FCMPReplicatedAcceleration
 
 	UPROPERTY()
 	int8 AccelZ = 0;	// Raw Z accel rate component, quantized to represent [-MaxAcceleration, MaxAcceleration]
+
+	void Pack(const FVector& Acceleration, double MaxAcceleration);
+	FVector Unpack(double MaxAcceleration) const;
+
+	bool operator==(const FCMPReplicatedAcceleration& Other) const
+	{
+		return AccelXYRadians == Other.AccelXYRadians && AccelXYMagnitude == Other.AccelXYMagnitude && AccelZ == Other.AccelZ;
+	}
+
+	bool operator!=(const FCMPReplicatedAcceleration& Other) const { return !(*this == Other); }
 };
 
 
-/** The type we use to send FastShared movement updates. */
+/** Location and velocity precision of FCMPCharacterRepMovement, coarser for characters far from the receiving viewer. */
+UENUM()
+enum class ECMPLocationQuantization : uint8
+{
+	TwoDecimals,	// 0.01 cm location, 1 cm/s velocity
+	WholeNumber,	// 1 cm location, 1 cm/s velocity
+	Decimetre,		// 10 cm location, 10 cm/s velocity with a coarser direction
+	MAX UMETA(Hidden)
+};
+
+
+/**
+ * FCMPCharacterRepMovement: Movement state of an ACMPCharacter as simulated proxies need it.
+ * Replaces FRepMovement for characters: the root stays upright so only yaw is sent, together with the view pitch,
+ * velocity is polar XY plus a small Z, acceleration is only sent when non-zero and the flags share a bitfield.
+ * The timestamp is sent as 16 bit milliseconds
+ * and unwrapped against the previous one by the receiving character.
+ */
 USTRUCT()
-struct FSharedRepMovement
+struct FCMPCharacterRepMovement
 {
 	GENERATED_BODY()
 
-	FSharedRepMovement();
+	static constexpr int32 VelocityDirectionBits = 12;
+	static constexpr int32 CoarseVelocityDirectionBits = 8;
 
 	bool FillForCharacter(ACharacter* Character);
-	bool Equals(const FSharedRepMovement& Other, ACharacter* Character) const;
+	bool Equals(const FCMPCharacterRepMovement& Other) const;
 
 	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
 
+	static double GetLocationScale(ECMPLocationQuantization InQuantization);
+	static double GetVelocityScale(ECMPLocationQuantization InQuantization);
+
+	/** Precision used by the following location and state. */
+	void SerializeQuantization(FArchive& Ar);
+
+	/** Location at Quantization precision. */
+	void SerializeLocation(FArchive& Ar);
+
+	/** Everything except location. */
+	void SerializeState(FArchive& Ar);
+
 	UPROPERTY(Transient)
-	FRepMovement RepMovement;
+	ECMPLocationQuantization Quantization = ECMPLocationQuantization::TwoDecimals;
 
 	UPROPERTY(Transient)
-	float RepTimeStamp = 0.0f;
+	FVector Location = FVector::ZeroVector;
 
 	UPROPERTY(Transient)
-	uint8 RepMovementMode = 0;
+	float Yaw = 0.f;
+
+	UPROPERTY(Transient)
+	float ViewPitch = 0.f;
+
+	UPROPERTY(Transient)
+	FVector Velocity = FVector::ZeroVector;
+
+	UPROPERTY(Transient)
+	FCMPReplicatedAcceleration Acceleration;
+
+	UPROPERTY(Transient)
+	uint16 TimeStampMs = 0;
+
+	UPROPERTY(Transient)
+	bool bHasTimeStamp = false;
+
+	UPROPERTY(Transient)
+	uint8 MovementMode = 0;
 
 	UPROPERTY(Transient)
 	bool bProxyIsJumpForceApplied = false;
 
 	UPROPERTY(Transient)
 	bool bIsCrouched = false;
+
+	UPROPERTY(Transient)
+	bool bIsJogging = false;
+
+	UPROPERTY(Transient)
+	bool bIsAiming = false;
+};
+
+template<>
+struct TStructOpsTypeTraits<FCMPCharacterRepMovement> : public TStructOpsTypeTraitsBase2<FCMPCharacterRepMovement>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
+
+/** The type we use to send FastShared movement updates. */
+USTRUCT()
+struct FSharedRepMovement
+{
+	GENERATED_BODY()
+
+	bool FillForCharacter(ACharacter* Character);
+	bool Equals(const FSharedRepMovement& Other, ACharacter* Character) const;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	/** Turns this into a delta against Keyframe. Returns false if the state is too far from it and must be sent as a keyframe. */
+	bool EncodeDelta(const FSharedRepMovement& Keyframe, uint8 InKeyframeId);
+
+	/** Rebuilds the full state of a received delta. Returns false if Keyframe is not the baseline it was encoded against. */
+	bool ApplyDelta(const FSharedRepMovement& Keyframe);
+
+	/** Keyframes carry the full state, other sends only carry the difference to the keyframe with the same id. */
+	UPROPERTY(Transient)
+	uint8 KeyframeId = 0;
+
+	UPROPERTY(Transient)
+	bool bIsKeyframe = true;
+
+	UPROPERTY(Transient)
+	FCMPCharacterRepMovement Movement;
+
+private:
+	// Location in units of Movement.Quantization
+	FIntVector DeltaLocation = FIntVector::ZeroValue;
 };
 
 template<>
@@ -85,21 +194,110 @@ protected:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category=Camera)
 	UCameraComponent* FPCamera;
 
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category=Weapon)
+	UCMPWeaponFireComponent* WeaponFireComponent;
+
 public:
 	UFUNCTION(BlueprintPure, Category=Camera)
 	FORCEINLINE UCameraComponent* GetFPCamera() const { return FPCamera; }
 
+	FORCEINLINE UCMPWeaponFireComponent* GetWeaponFireComponent() const { return WeaponFireComponent; }
+
 public:
 	ACMPCharacter(const FObjectInitializer& ObjectInitializer);
 
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
-	virtual void Tick(float DeltaTime) override;
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 	virtual void OnMovementModeChanged(EMovementMode PrevMovementMode, uint8 PreviousCustomMode) override;
 
+public:
+	virtual FRotator GetBaseAimRotation() const override;
+
+#pragma region Significance
+
+public:
+	/** Called by UCMPSignificanceManager. Sets the tick interval of this character, its components and attached guns. */
+	void SetSignificanceTier(ECMPSignificanceTier InTier);
+
+private:
+	ECMPSignificanceTier SignificanceTier{};
+	bool bRegisteredForSignificance = false;
+
+	void ApplySignificanceTickInterval(AActor* Actor, float TickInterval) const;
+#pragma endregion
+
+#pragma region Lag Compensation
+
+protected:
+	/** Bone capsules recorded by UCMPLagCompensationSubsystem on top of the movement capsule. */
+	UPROPERTY(EditDefaultsOnly, Category="LagCompensation")
+	TArray<FCMPHitboxCapsule> Hitboxes;
+
+public:
+	FORCEINLINE const TArray<FCMPHitboxCapsule>& GetHitboxes() const { return Hitboxes; }
+
+private:
+	bool bRegisteredForLagCompensation = false;
+#pragma endregion
+
+#pragma region Net Activity
+
+public:
+	/** Server: movement, view or weapon state changed. Wakes an idle character for replication immediately. */
+	void MarkNetActive();
+
+	/** Server: checks velocity, acceleration and view rotation after each processed move. */
+	void UpdateMovementActivity();
+
+	/** Server: applies the aim bit of a remote client's move, it reaches other clients with the replicated movement. */
+	void SetAimingFromMove(bool bWantsToAim);
+
+	/** Server: called by the replication graph each frame. Idle after IdleDelay seconds without activity, 0 disables. */
+	bool UpdateNetIdle(double IdleDelay);
+
+	FORCEINLINE bool IsNetIdle() const { return bIsNetIdle; }
+
+private:
+	double LastNetActivityTime = 0.0;
+	FRotator LastActivityViewRotation = FRotator::ZeroRotator;
+	bool bIsNetIdle = false;
+#pragma endregion
+
+#pragma region Pooling
+
+public:
+	/** Server: hides the character and its loadout and puts them to net dormancy. Called by UCMPCharacterPoolSubsystem. */
+	void ReleaseToPool();
+
+	/** Server: wakes a pooled character at SpawnTransform with a fresh loadout. Called by UCMPCharacterPoolSubsystem. */
+	void AcquireFromPool(const FTransform& SpawnTransform);
+
+	FORCEINLINE bool IsPooled() const { return bIsPooled; }
+
+private:
+	UPROPERTY(ReplicatedUsing=OnRep_IsPooled)
+	bool bIsPooled = false;
+
+	UFUNCTION()
+	void OnRep_IsPooled();
+
+	/** Bumped every time the character leaves the pool, even when released and acquired again in the same frame. */
+	UPROPERTY(ReplicatedUsing=OnRep_PoolGeneration)
+	uint8 PoolGeneration = 0;
+
+	UFUNCTION()
+	void OnRep_PoolGeneration();
+
+	/** Character and every actor attached to it, guns and their parts included. */
+	void GetPooledActors(TArray<AActor*>& OutActors);
+
+	void ResetLoadout();
+#pragma endregion
+
 
 #pragma region Input
 
@@ -132,6 +330,10 @@ private:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true"))
 	UInputAction* CrouchAction;
 
+	/** Fire Input Action */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true"))
+	UInputAction* FireAction;
+
 protected:
 	/** Called for movement input */
 	void Move(const FInputActionValue& Value);
@@ -150,6 +352,10 @@ protected:
 	/** Called for crouch input */
 	void CrouchPressed(const FInputActionValue& Value);
 
+	/** Called for fire input */
+	void FireStarted(const FInputActionValue& Value);
+	void FireFinished(const FInputActionValue& Value);
+
 	/** Called for jump input */
 	void JumpPressed(const FInputActionValue& Value);
 	void JumpReleased(const FInputActionValue& Value);
@@ -190,15 +396,21 @@ public:
 	FORCEINLINE AGunParent* GetCurrentWeapon() const { return CurrentWeapon; }
 
 protected:
-	UPROPERTY(BlueprintReadOnly, Replicated)
+	/** Sight and fire mode of the current weapon, the hand transform is derived from it on every machine. */
+	UPROPERTY(ReplicatedUsing=OnRep_WeaponViewState)
+	FCMPWeaponViewState WeaponViewState;
+
+	UPROPERTY(BlueprintReadOnly)
 	bool bInterpolateSight;
 	
-	UPROPERTY(BlueprintReadOnly, ReplicatedUsing=OnRep_HandTransform)
+	UPROPERTY(BlueprintReadOnly)
 	FTransform HandTransform;
 
 public:
-	void SetHandTransform(const FTransform& NewTransform);
-	void SetInterpolateSight(const bool NewInterpolateSight);
+	void SetWeaponViewState(const FCMPWeaponViewState& NewViewState);
+
+	/** Clients: derives the hand transform again after the parts of the current weapon changed. */
+	void RefreshWeaponViewState();
 	
 private:
 	UPROPERTY()
@@ -216,24 +428,12 @@ private:
 	void OnRep_CurrentWeapon();
 
 	UFUNCTION()
-	void OnRep_HandTransform();
+	void OnRep_WeaponViewState();
 
 private:
 	void EnterAiming();
 	void ExitAiming();
 
-	UFUNCTION(Server, Reliable)
-	void ServerEnterAiming();
-
-	UFUNCTION(NetMulticast, Reliable)
-	void MulticastEnterAiming();
-
-	UFUNCTION(Server, Reliable)
-	void ServerExitAiming();
-
-	UFUNCTION(NetMulticast, Reliable)
-	void MulticastExitAiming();
-
 public:
 	UFUNCTION(BlueprintCallable)
 	void SwitchWeapon();
@@ -241,6 +441,9 @@ public:
 	UFUNCTION(BlueprintPure)
 	FORCEINLINE bool IsWeaponEquipped() const { return CurrentWeapon != nullptr; }
 
+	UFUNCTION(BlueprintPure)
+	FORCEINLINE bool IsAiming() const { return bIsAiming; }
+
 private:
 	void SpawnGunsInventory();
 	void AddToGunInventory(AGunParent* Gun);
@@ -265,14 +468,37 @@ protected:
 
 public:
 	FTransform GetRightHandTransform(ERelativeTransformSpace TransformSpace) const;
+	FTransform GetEquippedGunTransform() const;
 
-private:
-	UPROPERTY(Transient, ReplicatedUsing = OnRep_ReplicatedAcceleration)
-	FCMPReplicatedAcceleration ReplicatedAcceleration;
+public:
+	/** Server: current acceleration as FCMPCharacterRepMovement sends it, only repacked when it changed. */
+	const FCMPReplicatedAcceleration& GetPackedAcceleration();
 
 private:
+	FCMPReplicatedAcceleration PackedAcceleration;
+
+	// Raw acceleration PackedAcceleration was last packed from
+	FVector LastPackedAcceleration = FVector::ZeroVector;
+
+	/** Replaces ReplicatedMovement and the character movement properties for simulated proxies. */
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_CMPReplicatedMovement)
+	FCMPCharacterRepMovement CMPReplicatedMovement;
+
 	UFUNCTION()
-	void OnRep_ReplicatedAcceleration();
+	void OnRep_CMPReplicatedMovement();
+
+	void ApplyReplicatedMovement(const FCMPCharacterRepMovement& Movement);
+
+	// Unwrapped server timestamp in ms, offset so it never reaches zero which means unused
+	int64 UnwrappedServerTimeStampMs = INDEX_NONE;
+	double LastTimeStampReceiveTime = 0.0;
+	float UnwrapServerTimeStamp(uint16 TimeStampMs);
+
+	// View pitch from the movement stream, at higher precision than RemoteViewPitch
+	float ReplicatedViewPitch = 0.f;
+
+	/** Gait of the server move, so simulated proxies use the same speed and braking as the owner. */
+	bool bIsJogging = false;
 
 public:
 	
@@ -283,5 +509,24 @@ public:
 	// Last FSharedRepMovement we sent, to avoid sending repeatedly.
 	FSharedRepMovement LastSharedReplication;
 
+	/** Set by the replication graph from the distance to the closest viewer before each FastShared update. */
+	void SetMovementQuantization(ECMPLocationQuantization InQuantization) { MovementQuantization = InQuantization; }
+	ECMPLocationQuantization GetMovementQuantization() const { return MovementQuantization; }
+
+private:
+	ECMPLocationQuantization MovementQuantization = ECMPLocationQuantization::TwoDecimals;
+
+	// Server: keyframe the following FastShared sends are encoded against
+	FSharedRepMovement SharedKeyframe;
+	uint8 SharedKeyframeId = 0;
+	int32 SharedSendsSinceKeyframe = INDEX_NONE;
+
+	// Client: last keyframe received through FastSharedReplication
+	FSharedRepMovement ReceivedSharedKeyframe;
+	bool bHasReceivedSharedKeyframe = false;
+	double LastSharedReceiveTime = 0.0;
+
+public:
+
 	virtual bool UpdateSharedReplication();
 };
@@ -4,6 +4,9 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "CMPCharacterNetworkMoveData.h"
+#include "CMPMovementTelemetry.h"
+#include "CMPSnapshotInterpolation.h"
 #include "CMPCharacterMovementComponent.generated.h"
 
 UENUM(BlueprintType)
@@ -50,6 +53,7 @@ class CRYMP_API UCMPCharacterMovementComponent : public UCharacterMovementCompon
 		typedef FSavedMove_Character Super;
 
 		uint8 Saved_bWantsToJog:1;
+		uint8 Saved_bWantsToAim:1;
 
 	public:
 		FSavedMove_CMP();
@@ -73,9 +77,15 @@ class CRYMP_API UCMPCharacterMovementComponent : public UCharacterMovementCompon
 		virtual FSavedMovePtr AllocateNewMove() override;
 	};
 
-	UPROPERTY(Replicated)
 	bool Safe_bWantsToJog;
 
+	bool Safe_bWantsToAim;
+
+	FCMPCharacterNetworkMoveDataContainer CMPNetworkMoveDataContainer;
+
+	/** Range used to quantize acceleration in ServerMove, the highest MaxAcceleration of all gaits. */
+	float AccelerationQuantizationRange = 0.f;
+
 protected:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Settings")
 	FGaitSettings JogSettings;
@@ -88,25 +98,89 @@ protected:
 
 	EGaits CurrentGait;
 
+	/** Simulated proxies play back buffered server snapshots instead of applying each update with stock smoothing. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Network|Snapshot Interpolation")
+	bool bUseSnapshotInterpolation = false;
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Network|Snapshot Interpolation",
+		meta=(EditCondition="bUseSnapshotInterpolation"))
+	FCMPSnapshotInterpolationSettings SnapshotInterpolationSettings;
+
+	/**
+	 * Locally controlled characters simulate in fixed steps of 1 / FixedTickRate instead of the frame time, and the mesh
+	 * is interpolated between the last two steps. Moves are never combined and the server snaps move deltas to whole
+	 * steps, so server and client run and replay identical simulations. Both sides must use the same settings.
+	 */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Network|Fixed Tick")
+	bool bUseFixedTickSimulation = false;
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Network|Fixed Tick",
+		meta=(EditCondition="bUseFixedTickSimulation", ClampMin=10, UIMin=10, ForceUnits=Hz))
+	float FixedTickRate = 60.f;
+
+	/** Steps simulated in one frame and in one server move at most, time beyond that is dropped so a hitch cannot spiral. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Network|Fixed Tick",
+		meta=(EditCondition="bUseFixedTickSimulation", ClampMin=1, UIMin=1))
+	int32 MaxFixedStepsPerFrame = 4;
+
+	/**
+	 * The server takes the location of remote clients instead of simulating their moves. Each location is checked
+	 * against the gait speed, acceleration and step height limits, and the path is swept every few moves. A failed check
+	 * simulates the move and corrects the client, then keeps simulating for a while. Tuned by CryMP.Movement.ClientAuth*.
+	 */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category="Network|Client Authority")
+	bool bUseClientAuthoritativeMovement = false;
+
 public:
 	UCMPCharacterMovementComponent();
 
 	virtual void InitializeComponent() override;
 	virtual void SimulateMovement(float DeltaTime) override;
 	virtual FNetworkPredictionData_Client* GetPredictionData_Client() const override;
+	virtual void SmoothCorrection(const FVector& OldLocation, const FQuat& OldRotation, const FVector& NewLocation,
+	                              const FQuat& NewRotation) override;
+
+	FORCEINLINE float GetAccelerationQuantizationRange() const { return AccelerationQuantizationRange; }
+
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	virtual float GetClientNetSendDeltaTime(const APlayerController* PC,
+	                                        const FNetworkPredictionData_Client_Character* ClientData,
+	                                        const FSavedMovePtr& NewMove) const override;
+	virtual void SendClientAdjustment() override;
+	virtual bool ClientUpdatePositionAfterServerUpdate() override;
+
+	FORCEINLINE const FCMPMovementTelemetry& GetTelemetry() const { return Telemetry; }
+	void ResetTelemetry() { Telemetry.Reset(); }
+
+	FORCEINLINE float GetFixedTimeStep() const { return 1.f / FixedTickRate; }
+	bool IsUsingFixedTickSimulation() const;
+
+	/** Simulated proxy: how far playback runs behind the newest snapshot, 0 without snapshot interpolation. */
+	float GetSnapshotDelay() const;
 
 protected:
+	virtual FVector RoundAcceleration(FVector InAccel) const override;
 	virtual void UpdateFromCompressedFlags(uint8 Flags) override;
+	virtual void PerformMovement(float DeltaTime) override;
 	virtual void OnMovementUpdated(float DeltaSeconds, const FVector& OldLocation, const FVector& OldVelocity) override;
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType,
 	                           FActorComponentTickFunction* ThisTickFunction) override;
+	virtual FVector ConsumeInputVector() override;
+	virtual void MoveAutonomous(float ClientTimeStamp, float DeltaTime, uint8 CompressedFlags,
+	                            const FVector& NewAccel) override;
+	virtual bool ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel,
+	                                    const FVector& ClientWorldLocation, const FVector& RelativeClientLocation,
+	                                    UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName,
+	                                    uint8 ClientMovementMode) override;
 
 public:
 	UFUNCTION(BlueprintCallable)
 	void StartJog();
 	UFUNCTION(BlueprintCallable)
 	void StopJog();
+
+	/** Aim intent travels with the saved moves, and aiming blocks the jog gait. */
+	void SetWantsToAim(bool bValue);
 	
 	UFUNCTION(BlueprintCallable)
 	void ToggleCrouch();
@@ -117,18 +191,85 @@ public:
 
 	void SetReplicatedAcceleration(const FVector& InAcceleration);
 
+	/** Simulated proxies do not predict gait, they take whatever the server sends in the movement stream. */
+	void SetReplicatedGait(EGaits InGait);
+
+	UFUNCTION(BlueprintPure)
+	FORCEINLINE EGaits GetCurrentGait() const { return CurrentGait; }
+
 protected:
 	UPROPERTY(Transient)
 	bool bHasReplicatedAcceleration = false;
 
 private:
-	void SetWantToJog(bool Value);
+	void SetGait(EGaits InGait);
 
-	UFUNCTION(Server, Reliable)
-	void ServerSetWantToJog(bool Value);
+	FCMPSnapshotBuffer SnapshotBuffer;
 
-	UFUNCTION(BlueprintPure)
-	FORCEINLINE EGaits GetCurrentGait() const { return CurrentGait; }
+	FCMPMovementTelemetry Telemetry;
+
+	// Server: error of the last move that needed a correction, counted once the correction is sent
+	float PendingCorrectionMagnitude = 0.f;
+
+	bool CanUseSnapshotInterpolation() const;
+	bool SimulateFromSnapshots(float DeltaTime);
+
+	// Frame time not yet simulated in fixed steps
+	float FixedTickAccumulator = 0.f;
+
+	// Input sampled once per frame and reused by every step of that frame
+	FVector FixedTickInputVector = FVector::ZeroVector;
+	bool bIsFixedStepping = false;
+
+	// Location before the last step, the mesh is drawn between it and the current location
+	FVector FixedTickPreviousLocation = FVector::ZeroVector;
+	bool bHasFixedTickPresentation = false;
+
+	// Server: fixed steps simulated for the moves of this remote client in the current frame
+	uint64 ServerFixedStepsFrame = 0;
+	int32 ServerFixedStepsThisFrame = 0;
+
+	/** Server: takes up to Steps from the per frame budget of CryMP.Movement.MaxServerFixedStepsPerFrame, returns how many it got. */
+	int32 ConsumeServerFixedSteps(int32 Steps);
+
+	// Server: time and fastest gait limit of moves since the last accepted client location
+	float ClientAuthoritativeTime = 0.f;
+	float ClientAuthoritativeMaxSpeed = 0.f;
+
+	// Server: path start and move count of the next collision sweep
+	TOptional<FVector> ClientAuthoritativeSweepStart;
+	int32 ClientAuthoritativeMovesSinceSweep = 0;
+
+	// Server: moves left to simulate after a failed validation
+	int32 ClientAuthorityRevokedMoves = 0;
+
+	bool CanAcceptClientAuthoritativeMove();
+	/** Returns the time the applied client location covers, 0 while the window is still open. */
+	float MoveClientAuthoritative(float ClientTimeStamp, float DeltaTime, uint8 CompressedFlags, const FVector& NewAccel);
+	bool ValidateClientAuthoritativeMove(const FVector& ClientLocation, float Elapsed, float MaxSpeed);
+
+	/** Minimum time in ms the owning client leaves between ServerMove calls, raised by the server when it runs out of frame budget. */
+	UPROPERTY(Transient, Replicated)
+	uint8 ServerMoveIntervalMs = 0;
+
+	float NextServerMoveIntervalUpdateTime = 0.f;
+
+	void UpdateServerMoveInterval();
+
+	void UpdateGait();
+	void UpdateNetActivity() const;
+	/** Server: the aim bit of remote client moves drives the character aim state. */
+	void UpdateAimFromMove() const;
+
+	/** Server: hands a processed remote client move to UCMPMovementValidationSubsystem. */
+	void AddMoveForValidation(const FVector& OldLocation, float OldMaxSpeed, float MovedTime);
+
+	// Server: speed limit of validated moves, follows a falling gait limit at the braking rate
+	float ValidationMaxSpeed = 0.f;
+
+	void TickFixed(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction);
+	void UpdateFixedTickPresentation();
+	void ResetFixedTickPresentation();
 
 	FORCEINLINE void UseGaitSettings(const FGaitSettings& Settings)
 	{
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementReplication.h"
+
+
+/**
+ * FCMPPackedAcceleration: Acceleration as sent with ServerMove.
+ * XY is a direction plus a magnitude relative to the fastest gait acceleration, Z is only sent when non-zero.
+ * UCMPCharacterMovementComponent::RoundAcceleration runs every move through Pack/Unpack, so client and server simulate the same value.
+ */
+struct CRYMP_API FCMPPackedAcceleration
+{
+	static constexpr int32 DirectionBits = 12;
+	static constexpr int32 MagnitudeBits = 10;
+
+	uint16 XYDirection = 0;	// Direction of XY accel component, quantized to represent [0, 2*pi)
+	uint16 XYMagnitude = 0;	// Magnitude of XY accel component, quantized to represent [0, Range]
+	int16 Z = 0;			// Z accel component, quantized to represent [-Range, Range]
+
+	void Pack(const FVector& Acceleration, double Range);
+	FVector Unpack(double Range) const;
+	void NetSerialize(FArchive& Ar);
+
+	bool operator==(const FCMPPackedAcceleration& Other) const
+	{
+		return XYDirection == Other.XYDirection && XYMagnitude == Other.XYMagnitude && Z == Other.Z;
+	}
+};
+
+
+/**
+ * FCMPCharacterNetworkMoveData: Move data with CMP specific packing.
+ * - Jump, crouch, jog and aim intent are packed as single bits, other compressed flags are only sent when set.
+ * - Acceleration uses FCMPPackedAcceleration, control rotation drops roll when it is zero.
+ * - Pending and old moves are delta encoded against the new move, which is always serialized first.
+ */
+struct CRYMP_API FCMPCharacterNetworkMoveData : public FCharacterNetworkMoveData
+{
+	typedef FCharacterNetworkMoveData Super;
+
+	virtual bool Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap,
+	                       ENetworkMoveType MoveType) override;
+
+private:
+	void SerializeTimeStamp(FArchive& Ar, const FCMPCharacterNetworkMoveData* Baseline);
+	void SerializeAcceleration(FArchive& Ar, double Range, const FCMPCharacterNetworkMoveData* Baseline);
+	void SerializeControlRotation(FArchive& Ar, const FCMPCharacterNetworkMoveData* Baseline);
+	void SerializeMoveFlags(FArchive& Ar, const FCMPCharacterNetworkMoveData* Baseline);
+};
+
+
+struct CRYMP_API FCMPCharacterNetworkMoveDataContainer : public FCharacterNetworkMoveDataContainer
+{
+	FCMPCharacterNetworkMoveDataContainer();
+
+	FCMPCharacterNetworkMoveData CMPMoveData[3];
+};
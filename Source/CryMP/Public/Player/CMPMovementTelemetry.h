@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+
+DECLARE_STATS_GROUP(TEXT("CryMP Movement"), STATGROUP_CryMPMovement, STATCAT_Advanced);
+
+
+/** Reason a saved move could not be combined with the pending one. */
+enum class ECMPCombineResult : uint8
+{
+	Combined,
+	RejectedGait,	// Safe_bWantsToJog differs
+	Rejected		// Any other reason
+};
+
+
+/**
+ * FCMPMovementTelemetry: Correction and move combining counters of one UCMPCharacterMovementComponent.
+ * On the server it counts corrections sent to that client, on the owning client corrections received, replayed moves
+ * and CanCombineWith results. Every sample also feeds the STATGROUP_CryMPMovement stats and the CryMPMovement CSV
+ * category. CryMP.Movement.DumpTelemetry logs all characters.
+ */
+struct CRYMP_API FCMPMovementTelemetry
+{
+	// Upper bounds in cm of the correction magnitude buckets, the last bucket is open
+	static constexpr float CorrectionBucketLimits[] = {1.f, 5.f, 25.f, 100.f, 500.f};
+	static constexpr int32 NumCorrectionBuckets = UE_ARRAY_COUNT(CorrectionBucketLimits) + 1;
+
+	// Upper bounds of the replayed moves per correction buckets, the last bucket is open
+	static constexpr int32 ReplayBucketLimits[] = {0, 2, 5, 10, 20};
+	static constexpr int32 NumReplayBuckets = UE_ARRAY_COUNT(ReplayBucketLimits) + 1;
+
+	uint32 CorrectionsSent = 0;
+	uint32 CorrectionMagnitudeHistogram[NumCorrectionBuckets] = {};
+	float MaxCorrectionMagnitude = 0.f;
+
+	uint32 CorrectionsReceived = 0;
+	uint32 MovesReplayed = 0;
+	uint32 ReplayedMovesHistogram[NumReplayBuckets] = {};
+
+	uint32 MovesCombined = 0;
+	uint32 CombineRejected = 0;
+	uint32 CombineRejectedByGait = 0;
+
+	void AddCorrectionSent(float Magnitude);
+	void AddCorrectionReceived(int32 ReplayedMoves);
+	void AddCombineResult(ECMPCombineResult Result);
+
+	void Reset() { *this = FCMPMovementTelemetry(); }
+	FString ToString() const;
+};
+
+
+#if !UE_BUILD_SHIPPING
+/** Cycles UCMPCharacterMovementComponent spends in movement while ACMPMovementBenchmark runs. Not compiled into shipping builds. */
+struct CRYMP_API FCMPMovementTimings
+{
+	uint64 PerformMovementCycles = 0;
+	uint32 PerformMovementCalls = 0;
+
+	// Nested in PerformMovement, includes gait selection
+	uint64 MovementUpdatedCycles = 0;
+	uint32 MovementUpdatedCalls = 0;
+
+	static FCMPMovementTimings* Active;
+};
+#endif
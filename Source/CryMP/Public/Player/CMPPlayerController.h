@@ -13,5 +13,14 @@ UCLASS()
 class CRYMP_API ACMPPlayerController : public APlayerController
 {
 	GENERATED_BODY()
-	
+
+public:
+	virtual void PlayerTick(float DeltaTime) override;
+
+	/** Returns the character to UCMPCharacterPoolSubsystem instead of destroying it. */
+	virtual void PawnLeavingGame() override;
+
+private:
+	/** Feeds the view of every local player to UCMPSignificanceManager, once per frame from the first local controller. */
+	void UpdateSignificance() const;
 };
@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CMPSnapshotInterpolation.generated.h"
+
+
+USTRUCT(BlueprintType)
+struct FCMPSnapshotInterpolationSettings
+{
+	GENERATED_BODY()
+
+	/** Lowest playback delay behind the server, in seconds. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", Units="s"))
+	float MinDelay = 0.05f;
+
+	/** Highest playback delay behind the server, in seconds. Jitter above this shows up as extrapolation. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", Units="s"))
+	float MaxDelay = 0.3f;
+
+	/** How many times the measured arrival jitter is added to the playback delay on top of the average send interval. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0"))
+	float JitterMultiplier = 2.f;
+
+	/** How long the newest snapshot may be extrapolated with its velocity and acceleration before the proxy holds still. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", Units="s"))
+	float MaxExtrapolationTime = 0.1f;
+
+	/** Server time gap after which the buffer is dropped and the proxy snaps to the new snapshot. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", Units="s"))
+	float MaxSnapshotGap = 1.f;
+};
+
+
+struct FCMPMovementSnapshot
+{
+	double ServerTime = 0.0;
+	FVector Location = FVector::ZeroVector;
+	FQuat Rotation = FQuat::Identity;
+	FVector Velocity = FVector::ZeroVector;
+	FVector Acceleration = FVector::ZeroVector;
+};
+
+
+/**
+ * FCMPSnapshotBuffer: Movement snapshots of a simulated proxy ordered by server timestamp.
+ * Playback runs behind the estimated server clock by the average send interval plus a multiple of the arrival jitter,
+ * positions are Hermite interpolated using the snapshot velocities and extrapolated for a bounded time when the buffer runs dry.
+ */
+class CRYMP_API FCMPSnapshotBuffer
+{
+public:
+	void Reset();
+
+	/** Returns false if the snapshot was dropped as out of order. */
+	bool AddSnapshot(const FCMPMovementSnapshot& Snapshot, double LocalTime,
+	                 const FCMPSnapshotInterpolationSettings& Settings);
+
+	/** Samples the buffer at LocalTime, also drops snapshots that playback has passed. */
+	bool Sample(double LocalTime, const FCMPSnapshotInterpolationSettings& Settings, FCMPMovementSnapshot& OutState);
+
+	FORCEINLINE bool IsEmpty() const { return Snapshots.IsEmpty(); }
+
+	double GetDelay(const FCMPSnapshotInterpolationSettings& Settings) const;
+
+private:
+	static constexpr int32 MaxSnapshots = 16;
+
+	TArray<FCMPMovementSnapshot, TInlineAllocator<MaxSnapshots>> Snapshots;
+
+	// Smoothed local time minus server time of arriving snapshots, biased towards the fastest arrivals
+	double ClockOffset = 0.0;
+	double Jitter = 0.0;
+	double AverageInterval = 0.0;
+	bool bHasClockOffset = false;
+};
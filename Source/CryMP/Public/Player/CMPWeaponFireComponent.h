@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "System/CMPLagCompensationSubsystem.h"
+#include "CMPWeaponFireComponent.generated.h"
+
+
+class ACMPCharacter;
+class AGunParent;
+
+
+/** One shot fired by the owning client. */
+struct FCMPShot
+{
+	/** Client estimate of the server time the shot was fired at, in seconds. Shots between two frames keep their spacing. */
+	double Time = 0.0;
+
+	/** View pitch and yaw the shot was fired with, roll is not sent. */
+	FRotator Aim = FRotator::ZeroRotator;
+
+	/** Shot sequence number of the owner, also seeds the spread so the server rolls the same direction. */
+	uint16 Seed = 0;
+
+	/** Direction of the shot with the spread of Gun applied, rolled from Seed and the server chosen Salt. */
+	FVector GetDirection(const AGunParent& Gun, bool bAiming, uint32 Salt) const;
+};
+
+
+/**
+ * FCMPShotBatch: Every shot the owner fired since the last send, sent in one unreliable ServerFire.
+ * Times go out as 0.1 ms ticks, the first one in full and the others as the delta to the previous shot, and the aim as
+ * two 16 bit axes, so an extra shot in a batch costs about six bytes. ViewDelay goes out in whole milliseconds.
+ */
+USTRUCT()
+struct FCMPShotBatch
+{
+	GENERATED_BODY()
+
+	static constexpr int32 MaxShots = 16;
+
+	TArray<FCMPShot, TInlineAllocator<MaxShots>> Shots;
+
+	/** How far behind the shot times the owner saw other characters, in seconds. Where lag compensation rewinds to. */
+	float ViewDelay = 0.f;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FCMPShotBatch> : public TStructOpsTypeTraitsBase2<FCMPShotBatch>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
+
+DECLARE_MULTICAST_DELEGATE_FiveParams(FCMPShotAcceptedDelegate, ACMPCharacter* /*Character*/, const FCMPShot& /*Shot*/, const FVector& /*Origin*/, const FVector& /*Direction*/, const FCMPRewindHit& /*Hit*/);
+
+
+/**
+ * Firing of the current weapon of an ACMPCharacter. The owning client fires on its own clock in Semi, Burst and Auto,
+ * timing each shot between frames at the gun fire rate, and sends the shots batched over CryMP.Fire.BatchWindow.
+ * The server checks every shot against the fire rate, the shot sequence and the magazine, traces it against the
+ * characters as the owner saw them through UCMPLagCompensationSubsystem and reports it through OnShotAccepted.
+ */
+UCLASS(ClassGroup=(CryMP))
+class CRYMP_API UCMPWeaponFireComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UCMPWeaponFireComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType,
+	                           FActorComponentTickFunction* ThisTickFunction) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	/** Owner: trigger pulled and released. */
+	void StartFire();
+	void StopFire();
+
+	/** Server: forgets the shot history and picks a new spread salt, for a character taken out of the pool. */
+	void ResetFiring();
+
+	/** Server: every shot that passed validation, with the server side origin, spread direction and lag compensated hit. */
+	FCMPShotAcceptedDelegate OnShotAccepted;
+
+protected:
+	virtual void BeginPlay() override;
+
+private:
+	/** Server chosen and sent to the owner only, mixed into every spread roll so the seed alone does not decide it. */
+	UPROPERTY(Replicated)
+	uint32 SpreadSalt = 0;
+
+	UFUNCTION(Server, Unreliable)
+	void ServerFire(const FCMPShotBatch& Batch);
+
+	/** Plays the fire montage on everyone but the shooter, once per accepted batch. */
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastShotsFired(uint8 NumShots);
+
+	ACMPCharacter* GetCharacter() const;
+	AGunParent* GetGun() const;
+	double GetServerTime() const;
+	/** Owner: latency to the server plus the playback delay of simulated characters. */
+	float GetViewDelay() const;
+	/** Server: the character hit by a shot, static world geometry stops it. */
+	void TraceShot(const AGunParent& Gun, const FCMPShot& Shot, float ViewDelay, const FVector& Origin,
+	               const FVector& Direction, FCMPRewindHit& OutHit) const;
+
+	void FireShot(AGunParent& Gun, double ShotTime);
+	void SendPendingShots();
+	void ProcessShots(const FCMPShotBatch& Batch);
+	bool ValidateShot(const AGunParent& Gun, const FCMPShot& Shot, double ServerTime);
+	void PlayFireMontage() const;
+
+	// Owner
+	FCMPShotBatch PendingShots;
+	double PendingSince = 0.0;
+	double NextShotTime = 0.0;
+	int32 ShotsLeftInBurst = 0;
+	uint16 NextSeed = 0;
+	bool bTriggerHeld = false;
+	bool bTriggerPulled = false;
+
+	// Server
+	double LastAcceptedShotTime = -1.0;
+	double LastAcceptedServerTime = 0.0;
+	double LastCreditTime = 0.0;
+	float ShotCredit = 0.f;
+	uint16 LastAcceptedSeed = 0;
+	bool bHasAcceptedShot = false;
+};
@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "CMPCharacterPoolSubsystem.generated.h"
+
+
+class ACMPCharacter;
+
+
+USTRUCT()
+struct FCMPCharacterPoolList
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<TObjectPtr<ACMPCharacter>> Characters;
+};
+
+
+/**
+ * Server-side pool of characters together with their spawned and assembled guns. Released characters are hidden and
+ * put to net dormancy instead of being destroyed, and acquiring one resets its loadout and wakes it up again, so a
+ * respawn does not spawn or destroy any replicated actor. Used by ACMPGameMode and ACMPPlayerController.
+ */
+UCLASS()
+class CRYMP_API UCMPCharacterPoolSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+
+	static UCMPCharacterPoolSubsystem* Get(const UWorld* World);
+
+	/** A pooled character of exactly this class moved to SpawnTransform, or nullptr if none is available. */
+	ACMPCharacter* AcquireCharacter(UClass* CharacterClass, const FTransform& SpawnTransform);
+
+	/** Takes an unpossessed character out of play. Destroys it instead if the pool for its class is full. */
+	void ReleaseCharacter(ACMPCharacter* Character);
+
+	/** Spawns characters straight into the pool, so the first respawn wave does not spawn them either. */
+	void PrewarmCharacters(UClass* CharacterClass, int32 Count);
+
+	int32 GetNumPooled(UClass* CharacterClass) const;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+	UPROPERTY()
+	TMap<TObjectPtr<UClass>, FCMPCharacterPoolList> Pools;
+};
@@ -0,0 +1,94 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Guns/GunParent.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "CMPGunAssemblyCache.generated.h"
+
+
+/** A sight by the index of the part that owns each aim point, -1 for the gun itself, so any instance can resolve it. */
+struct FCMPCachedSight
+{
+	ESightTypes SightType = ESightTypes::EST_IronSight;
+	int32 OpticOrFrontOwner = INDEX_NONE;
+	FName OpticOrFrontSocket;
+	int32 RearOwner = INDEX_NONE;
+	FName RearSocket;
+};
+
+
+/** One part a gun is assembled from, as in StartingParts or the replicated loadout. */
+struct FCMPGunAssemblyPart
+{
+	TObjectKey<UClass> PartClass;
+	int32 BaseIndex = INDEX_NONE;
+	FName BaseSocket;
+	bool bActioned = false;
+
+	bool operator==(const FCMPGunAssemblyPart& Other) const
+	{
+		return PartClass == Other.PartClass && BaseIndex == Other.BaseIndex && BaseSocket == Other.BaseSocket &&
+			bActioned == Other.bActioned;
+	}
+};
+
+
+/** A gun class and its parts in the order of AGunParent::CurrentParts. Equal only if every part is, not just the hash. */
+struct FCMPGunAssemblyKey
+{
+	TObjectKey<UClass> GunClass;
+	TArray<FCMPGunAssemblyPart> Parts;
+	uint32 Hash = 0;
+
+	FCMPGunAssemblyKey() = default;
+	FCMPGunAssemblyKey(const UClass* InGunClass, TArray<FCMPGunAssemblyPart>&& InParts);
+
+	bool operator==(const FCMPGunAssemblyKey& Other) const
+	{
+		return Hash == Other.Hash && GunClass == Other.GunClass && Parts == Other.Parts;
+	}
+
+	friend uint32 GetTypeHash(const FCMPGunAssemblyKey& Key)
+	{
+		return Key.Hash;
+	}
+};
+
+
+/** The result of assembling one gun class with one set of parts. Part data is in the order of AGunParent::CurrentParts. */
+struct FCMPGunAssembly
+{
+	/** Root transform of each part relative to the socket it is attached to. */
+	TArray<FTransform> PartTransforms;
+
+	float AddSpreadAiming = 0.f;
+	float AddSpreadHip = 0.f;
+	float AddRecoilPerShot = 0.f;
+
+	TArray<FCMPCachedSight> Sights;
+};
+
+
+/**
+ * Assemblies of every gun class and part set seen so far. The first instance assembles from geometry and stores the
+ * result, later instances place their parts, add up their stats and build their sights from it. Lives on the game
+ * instance, so it survives map changes.
+ */
+UCLASS()
+class CRYMP_API UCMPGunAssemblyCache : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	static UCMPGunAssemblyCache* Get(const UObject* WorldContextObject);
+
+	const FCMPGunAssembly* Find(const FCMPGunAssemblyKey& Key) const;
+	void Add(FCMPGunAssemblyKey&& Key, FCMPGunAssembly&& Assembly);
+
+	virtual void Deinitialize() override;
+
+private:
+	TMap<FCMPGunAssemblyKey, FCMPGunAssembly> Assemblies;
+};
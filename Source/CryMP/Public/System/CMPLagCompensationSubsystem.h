@@ -0,0 +1,147 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "CMPLagCompensationSubsystem.generated.h"
+
+
+class ACMPCharacter;
+
+
+/** A capsule between two bones of the character mesh, recorded for lag compensated hits. */
+USTRUCT(BlueprintType)
+struct FCMPHitboxCapsule
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly)
+	FName StartBone;
+
+	/** Same as StartBone for a sphere. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly)
+	FName EndBone;
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, meta=(ClampMin="0", Units="cm"))
+	float Radius = 10.f;
+};
+
+
+struct FCMPRewindHit
+{
+	ACMPCharacter* Character = nullptr;
+
+	/**
+	 * 0 for the movement capsule, which is only hit for characters without posed bone capsules, otherwise one past the
+	 * index in ACMPCharacter::GetHitboxes.
+	 */
+	int32 HitboxIndex = INDEX_NONE;
+
+	/** Distance along the ray to where it enters the hitbox. */
+	float Distance = 0.f;
+
+	FORCEINLINE bool IsHit() const { return Character != nullptr; }
+};
+
+
+/**
+ * FCMPHitboxHistory: The last MaxFrames hitbox snapshots of one character in a ring. Every coordinate is its own column
+ * indexed by frame * NumPadded + hitbox, with the hitbox count padded to four so a frame is tested four hitboxes at a
+ * time. Each frame also keeps a bounding sphere for the broad phase.
+ */
+struct FCMPHitboxHistory
+{
+	static constexpr int32 MaxFrames = 64;
+
+	ACMPCharacter* Character = nullptr;
+
+	// Movement capsule first, then the bone capsules
+	int32 NumHitboxes = 0;
+	int32 NumPadded = 0;
+	TArray<int32> StartBoneIndices;
+	TArray<int32> EndBoneIndices;
+	TArray<float> Radii;
+
+	double FrameTimes[MaxFrames] = {};
+	float BoundX[MaxFrames] = {};
+	float BoundY[MaxFrames] = {};
+	float BoundZ[MaxFrames] = {};
+	float BoundRadius[MaxFrames] = {};
+
+	/** Every bone capsule of the frame came from the mesh pose. */
+	bool bBonesPosed[MaxFrames] = {};
+
+	TArray<float> StartX;
+	TArray<float> StartY;
+	TArray<float> StartZ;
+	TArray<float> EndX;
+	TArray<float> EndY;
+	TArray<float> EndZ;
+
+	// Slot the next frame is written to
+	int32 Head = 0;
+	int32 NumFrames = 0;
+
+	FORCEINLINE int32 GetSlot(int32 Age) const { return (Head - 1 - Age + MaxFrames) % MaxFrames; }
+
+	/** The two recorded frames around Time and how far Time is between them, clamped to the recorded range. */
+	bool FindFrames(double Time, int32& OutFromSlot, int32& OutToSlot, float& OutAlpha) const;
+};
+
+
+/**
+ * Server-side lag compensation for ACMPCharacter. Records the movement capsule and bone capsules of every character at
+ * the end of each frame, and traces rays against them as they were at a past time by interpolating the recorded frames.
+ * Characters are never moved back and the physics scene is not used, a trace is a broad phase over four bounding
+ * spheres at a time followed by four ray to capsule tests at a time on the characters it passes. Once the bones are
+ * posed only the bone capsules are hit, the movement capsule stands in for them until then.
+ * Bone capsules need the mesh pose to be updated on the server, see USkinnedMeshComponent::VisibilityBasedAnimTickOption.
+ */
+UCLASS()
+class CRYMP_API UCMPLagCompensationSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	static UCMPLagCompensationSubsystem* Get(const UWorld* World);
+
+	void RegisterCharacter(ACMPCharacter* Character);
+	void UnregisterCharacter(ACMPCharacter* Character);
+
+	/**
+	 * Closest hitbox along the ray as the characters were at Time, which is clamped to CryMP.LagCompensation.MaxRewindTime.
+	 * Direction must be normalized.
+	 */
+	bool TraceRewound(double Time, const FVector& Origin, const FVector& Direction, float Distance,
+	                  const AActor* IgnoredActor, FCMPRewindHit& OutHit);
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+	TArray<FCMPHitboxHistory> Histories;
+
+	// Scratch of TraceRewound, kept to avoid allocating per shot
+	TArray<float> CandidateX;
+	TArray<float> CandidateY;
+	TArray<float> CandidateZ;
+	TArray<float> CandidateRadius;
+	TArray<int32> CandidateHistories;
+	TArray<float> RewoundStartX;
+	TArray<float> RewoundStartY;
+	TArray<float> RewoundStartZ;
+	TArray<float> RewoundEndX;
+	TArray<float> RewoundEndY;
+	TArray<float> RewoundEndZ;
+
+	void RecordFrame(FCMPHitboxHistory& History, double Time) const;
+
+	/** Tests the ray against every hitbox of History at Time, keeps the hit if it is closer than OutHit. */
+	void TraceHistory(const FCMPHitboxHistory& History, double Time, const FVector& Origin, const FVector& Direction,
+	                  float Distance, FCMPRewindHit& OutHit);
+};
@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Player/CMPMovementTelemetry.h"
+#include "CMPMovementBenchmark.generated.h"
+
+
+class ACMPCharacter;
+
+
+/**
+ * Spawns uncontrolled CMP characters driven by scripted input and measures the server cost of simulating them.
+ * Started with CryMP.Benchmark.Movement, meant for a headless server on a map with a floor around the first player start:
+ *     CryMPServer <Map> -server -nullrhi -ExecCmds="CryMP.Benchmark.Movement Count=256 Duration=30 Quit"
+ * Results are written as JSON to Saved/Benchmarks for comparison between builds. Not available in shipping builds.
+ */
+UCLASS(NotPlaceable, Transient)
+class CRYMP_API ACMPMovementBenchmark : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	ACMPMovementBenchmark();
+
+	/** Character class, count and timing of the run. Must be set before the actor begins play. */
+	void Configure(TSubclassOf<ACMPCharacter> InCharacterClass, int32 InCount, float InWarmup, float InDuration, bool bInQuitWhenDone);
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	struct FAgentScript
+	{
+		FRandomStream Random;
+		FVector Direction = FVector::ZeroVector;
+		float NextDirectionTime = 0.f;
+		float NextGaitTime = 0.f;
+		float NextCrouchTime = 0.f;
+		float NextJumpTime = 0.f;
+		bool bJogging = false;
+	};
+
+	UPROPERTY()
+	TSubclassOf<ACMPCharacter> CharacterClass;
+
+	UPROPERTY()
+	TArray<TObjectPtr<ACMPCharacter>> Characters;
+
+	TArray<FAgentScript> Scripts;
+
+	int32 Count = 256;
+	float Warmup = 2.f;
+	float Duration = 30.f;
+	bool bQuitWhenDone = false;
+
+	double StartTime = 0.0;
+	bool bMeasuring = false;
+
+#if !UE_BUILD_SHIPPING
+	FCMPMovementTimings Timings;
+#endif
+
+	// Game thread time of each measured frame in ms
+	TArray<float> FrameTimes;
+
+	uint64 StartUsedPhysical = 0;
+	int32 StartObjectCount = 0;
+
+	void SpawnCharacters();
+	void DriveCharacters(float Time);
+
+	void StartMeasuring();
+	void FinishMeasuring();
+	void WriteResults() const;
+};
@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "CMPMovementValidationSubsystem.generated.h"
+
+
+class ACMPCharacter;
+class UCMPCharacterMovementComponent;
+
+
+UENUM(meta=(Bitflags, UseEnumValuesAsMaskValuesInEditor="true"))
+enum class ECMPMovementViolation : uint8
+{
+	None = 0,
+	Speed = 1 << 0,		// Horizontal distance beyond the gait max speed
+	Teleport = 1 << 1,	// Distance beyond CryMP.MovementValidation.TeleportDistance in a single move
+	Fly = 1 << 2		// Height gain beyond what walking or jumping allows
+};
+ENUM_CLASS_FLAGS(ECMPMovementViolation);
+
+
+DECLARE_MULTICAST_DELEGATE_TwoParams(FCMPMovementViolationDelegate, ACMPCharacter* /*Character*/, ECMPMovementViolation /*Violations*/);
+
+
+/**
+ * Server-side plausibility checks for every client move processed in a frame. UCMPCharacterMovementComponent adds each
+ * move to flat per-field arrays, and one pass at the end of the frame checks four moves at a time. Violations are
+ * reported once per character and frame through OnMovementViolation, which game code can use to correct or kick.
+ */
+UCLASS()
+class CRYMP_API UCMPMovementValidationSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/** MaxSpeed is the highest speed the move may reach, the caller accounts for a limit lowered during the move. */
+	void AddMove(ACMPCharacter* Character, const FVector& Delta, float DeltaTime, float MaxSpeed,
+	             const UCMPCharacterMovementComponent& Movement);
+
+	FCMPMovementViolationDelegate OnMovementViolation;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+	// One entry per move, padded with zeroed moves to a multiple of four before validation
+	TArray<float> DeltaX;
+	TArray<float> DeltaY;
+	TArray<float> DeltaZ;
+	TArray<float> DeltaTimes;
+	TArray<float> MaxSpeeds;
+	TArray<float> MaxRiseSpeeds;
+	TArray<float> RiseSlacks;
+
+	// Only read for reporting
+	TArray<ACMPCharacter*> Characters;
+	TArray<uint8> Gaits;
+	TArray<uint8> MovementModes;
+
+	TMap<ACMPCharacter*, ECMPMovementViolation> FrameViolations;
+
+	void ValidateMoves();
+	void ReportViolations();
+	void ResetMoves();
+};
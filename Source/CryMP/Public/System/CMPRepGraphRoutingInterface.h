@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Interface.h"
+#include "CMPReplicationGraphTypes.h"
+#include "CMPRepGraphRoutingInterface.generated.h"
+
+
+UINTERFACE(MinimalAPI, meta=(CannotImplementInterfaceInBlueprint))
+class UCMPRepGraphRoutingInterface : public UInterface
+{
+	GENERATED_BODY()
+};
+
+/**
+ * Lets a single actor instance override the class based routing of UCMPReplicationGraph.
+ * e.g. a placed objective that never moves can ask for Spatialize_Static even though its class is Spatialize_Dynamic.
+ * The graph asks once, when the actor is added, and keeps the answer until the actor is removed.
+ */
+class CRYMP_API ICMPRepGraphRoutingInterface
+{
+	GENERATED_BODY()
+
+public:
+	/** Return true and fill OutMapping to route this actor with OutMapping instead of its class mapping. */
+	virtual bool GetReplicationGraphNodeMapping(EClassRepNodeMapping& OutMapping) const = 0;
+};
@@ -8,13 +8,24 @@
 #include "CMPReplicationGraph.generated.h"
 
 
+class ACMPCharacter;
 class UReplicationGraphNode_ActorList;
 class UReplicationGraphNode_GridSpatialization2D;
+enum class ECMPLocationQuantization : uint8;
 
 
 DECLARE_LOG_CATEGORY_EXTERN(LogCryMPRepGraph, Display, All);
 
 
+/** A character tracked for idle detection, with the period it replicates at while active. */
+struct FCMPNetIdleCharacter
+{
+	ACMPCharacter* Character = nullptr;
+	uint32 ActiveReplicationPeriodFrame = 1;
+	bool bIdle = false;
+};
+
+
 UCLASS(Transient, Config=Engine)
 class CRYMP_API UCMPReplicationGraph : public UReplicationGraph
 {
@@ -27,6 +38,14 @@ public:
 	virtual void InitGlobalActorClassSettings() override;
 	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
 	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+	virtual int32 ServerReplicateActors(float DeltaSeconds) override;
+
+	/** Movement precision for a character, from its distance to the closest viewer of another connection. */
+	ECMPLocationQuantization GetMovementQuantization(const AActor* Actor) const;
+
+	/** Movement precision for a character at Location as Connection sees it. False if the connection has no viewer this frame. */
+	bool GetMovementQuantizationForConnection(const FVector& Location, const UNetConnection* Connection,
+	                                          ECMPLocationQuantization& OutQuantization) const;
 
 	UPROPERTY()
 	TObjectPtr<UReplicationGraphNode_GridSpatialization2D> GridNode;
@@ -40,6 +59,7 @@ private:
 	void AddClassRepInfo(UClass* Class, EClassRepNodeMapping Mapping);
 	void RegisterClassRepNodeMapping(UClass* Class);
 	EClassRepNodeMapping GetClassNodeMapping(UClass* Class) const;
+	EClassRepNodeMapping GetActorNodeMapping(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo);
 	
 	void RegisterClassReplicationInfo(UClass* Class);
 	bool ConditionalInitClassReplicationInfo(UClass* Class, FClassReplicationInfo& ClassInfo);
@@ -51,7 +71,21 @@ private:
 	}
 	
 	TClassMap<EClassRepNodeMapping> ClassRepNodePolicies;
+
+	/** Actors that picked their own routing through ICMPRepGraphRoutingInterface. Used to remove them from the same node they were added to. */
+	TMap<FActorRepListType, EClassRepNodeMapping> ActorRepNodePolicies;
 	
+	/** Every replicated character, their replication period is lowered while they are idle. */
+	TArray<FCMPNetIdleCharacter> NetIdleCharacters;
+
+	static ECMPLocationQuantization GetMovementQuantizationForDistSq(double DistSq);
+
+	void UpdateNetIdleCharacters();
+	void SetActorReplicationPeriod(AActor* Actor, uint32 ReplicationPeriodFrame);
+
+	/** View location of every connection, gathered once per frame before replication. */
+	TArray<TPair<const UNetConnection*, FVector>> ViewerLocations;
+
 	/** Classes that had their replication settings explictly set by code in ULyraReplicationGraph::InitGlobalActorClassSettings */
 	TArray<UClass*> ExplicitlySetClasses;
 };
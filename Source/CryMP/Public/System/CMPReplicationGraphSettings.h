@@ -33,6 +33,21 @@ public:
 	UPROPERTY(EditAnywhere, Category = FastSharedPath, meta = (ConsoleVariable = "Lyra.RepGraph.FastSharedPathCullDistPct"))
 	float FastSharedPathCullDistPct = 0.80f;
 
+	// Characters farther than this from every other viewer send movement at whole centimetre precision. 0 disables.
+	UPROPERTY(EditAnywhere, Category = FastSharedPath, meta = (ForceUnits=cm, ConsoleVariable = "CryMP.RepGraph.MovementWholeNumberQuantizationDist"))
+	float MovementWholeNumberQuantizationDist = 5000.f;
+
+	// Characters farther than this from every other viewer send movement at decimetre precision. 0 disables.
+	UPROPERTY(EditAnywhere, Category = FastSharedPath, meta = (ForceUnits=cm, ConsoleVariable = "CryMP.RepGraph.MovementDecimetreQuantizationDist"))
+	float MovementDecimetreQuantizationDist = 15000.f;
+
+	// Characters without movement, view or weapon activity for this long are replicated at IdleNetUpdateFrequency. 0 disables.
+	UPROPERTY(EditAnywhere, Category = IdleCharacters, meta = (ForceUnits=s, ConsoleVariable = "CryMP.RepGraph.NetIdleDelay"))
+	float NetIdleDelay = 2.f;
+
+	UPROPERTY(EditAnywhere, Category = IdleCharacters, meta = (ForceUnits=Hz, ConsoleVariable = "CryMP.RepGraph.IdleNetUpdateFrequency"))
+	float IdleNetUpdateFrequency = 2.f;
+
 	UPROPERTY(EditAnywhere, Category = DestructionInfo, meta = (ForceUnits = cm, ConsoleVariable = "Lyra.RepGraph.DestructInfo.MaxDist"))
 	float DestructionInfoMaxDist = 30000.f;
 
@@ -0,0 +1,51 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SignificanceManager.h"
+#include "CMPSignificanceManager.generated.h"
+
+
+class ACMPCharacter;
+
+
+UENUM(BlueprintType)
+enum class ECMPSignificanceTier : uint8
+{
+	Full,
+	Reduced,
+	Low,
+	Minimal
+};
+
+
+/**
+ * Scores simulated proxy characters on clients by their projected size from the local viewpoint, scaled down when they
+ * were not rendered recently. The score maps to a tier, and each tier sets the tick interval of the character, its
+ * movement component and its attached guns. Updated by ACMPPlayerController::PlayerTick.
+ */
+UCLASS()
+class CRYMP_API UCMPSignificanceManager : public USignificanceManager
+{
+	GENERATED_BODY()
+
+public:
+	UCMPSignificanceManager();
+
+	static UCMPSignificanceManager* Get(const UWorld* World);
+
+	void RegisterCharacter(ACMPCharacter* Character);
+	void UnregisterCharacter(ACMPCharacter* Character);
+
+	static float GetTickInterval(ECMPSignificanceTier Tier);
+
+private:
+	static const FName CharacterTag;
+
+	static float CalculateCharacterSignificance(FManagedObjectInfo* ObjectInfo, const FTransform& Viewpoint);
+	static void OnCharacterSignificanceChanged(FManagedObjectInfo* ObjectInfo, float OldSignificance,
+	                                           float Significance, bool bFinal);
+
+	static ECMPSignificanceTier GetTier(float Significance);
+};
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/EngineSubsystem.h"
+#include "CMPSocketClassificationCache.generated.h"
+
+
+class AAssemblableParent;
+
+
+/** Socket name prefixes an assemblable class looks for, empty ones match nothing. */
+struct FCMPSocketPrefixes
+{
+	FString OpticAimPoint;
+	FString FrontAimPoint;
+	FString RearAimPoint;
+	FString Top;
+};
+
+
+/** Sockets of one mesh asset sorted by prefix, in the order the mesh reports them. */
+struct FCMPSocketClassification
+{
+	TArray<FName> OpticAimPoints;
+	TArray<FName> FrontAimPoints;
+	TArray<FName> RearAimPoints;
+	FName TopSocket = NAME_None;
+
+	void Build(const UMeshComponent& MeshComponent, const FCMPSocketPrefixes& Prefixes);
+};
+
+
+/**
+ * Socket classifications per mesh asset and assemblable class. Prefixes are class defaults, so the class stands in for
+ * the prefix set, and the string matching runs once per pair instead of in the BeginPlay of every part. Also keeps the
+ * lexically sorted socket names per mesh asset that gun loadouts index sockets by.
+ */
+UCLASS()
+class CRYMP_API UCMPSocketClassificationCache : public UEngineSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	static UCMPSocketClassificationCache* Get();
+
+	/** Cached classification of the mesh of Part. Meshes without an asset are classified into Scratch instead. */
+	const FCMPSocketClassification& Classify(const AAssemblableParent& Part, const UMeshComponent& MeshComponent,
+	                                         FCMPSocketClassification& Scratch);
+
+	/** Cached socket names of the mesh in FNameLexicalLess order. Meshes without an asset are sorted into Scratch. */
+	const TArray<FName>& GetSortedSocketNames(const UMeshComponent& MeshComponent, TArray<FName>& Scratch);
+
+	virtual void Deinitialize() override;
+
+private:
+	TMap<TPair<TObjectKey<UObject>, TObjectKey<UClass>>, FCMPSocketClassification> Classifications;
+
+	TMap<TObjectKey<UObject>, TArray<FName>> SortedSocketNames;
+
+	static const UObject* GetMeshAsset(const UMeshComponent& MeshComponent);
+};